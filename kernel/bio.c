@@ -23,6 +23,10 @@
 #include "fs.h"
 #include "buf.h"
 
+#if BSIZE % 512 != 0 || PGSIZE % BSIZE != 0
+#error "BSIZE must be a multiple of 512 that divides PGSIZE"
+#endif
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
@@ -33,13 +37,60 @@ struct {
   struct buf head;
 } bcache;
 
+struct bdevsw bdevsw[ROOTDEV+NDISK];
+
+// the driver for device dev.
+static struct bdevsw*
+bdev(uint dev)
+{
+  if(dev >= ROOTDEV+NDISK || bdevsw[dev].nblocks == 0)
+    panic("bdev: no such disk");
+  return &bdevsw[dev];
+}
+
+// Size of device dev in BSIZE blocks, or 0 if there is no such disk.
+uint64
+bnblocks(uint dev)
+{
+  if(dev >= ROOTDEV+NDISK || bdevsw[dev].nblocks == 0)
+    return 0;
+  return bdevsw[dev].nblocks(dev);
+}
+
+// Transfer len bytes, a multiple of BSIZE, between the blocks
+// of device dev starting at blockno and the physical address pa,
+// without going through the buffer cache. The caller is
+// responsible for coherence with any cached copies of those blocks.
+void
+brw_direct(uint dev, uint blockno, uint64 pa, uint len, int write)
+{
+  if(len == 0 || len % BSIZE)
+    panic("brw_direct");
+  bdev(dev)->rw_direct(dev, blockno, pa, len, write);
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  char *pg = 0;
+  int off = PGSIZE;
 
   initlock(&bcache.lock, "bcache");
 
+  // Carve buffer memory out of whole pages, so that with
+  // BSIZE == PGSIZE each b->mem is a page-aligned page.
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(off == PGSIZE){
+      if((pg = kalloc()) == 0)
+        panic("binit");
+      off = 0;
+    }
+    b->mem = (uchar*)pg + off;
+    b->data = b->mem;
+    off += BSIZE;
+  }
+
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
@@ -79,6 +130,7 @@ bget(uint dev, uint blockno)
       b->dev = dev;
       b->blockno = blockno;
       b->valid = 0;
+      b->data = b->mem;
       b->refcnt = 1;
       release(&bcache.lock);
       acquiresleep(&b->lock);
@@ -88,15 +140,43 @@ bget(uint dev, uint blockno)
   panic("bget: no buffers");
 }
 
+// Is the block in the buffer cache? The answer can only be
+// relied on if the caller prevents the block from being read
+// or written through the cache meanwhile, for example by
+// holding the lock of the inode that owns it.
+int
+bcached(uint dev, uint blockno)
+{
+  struct buf *b;
+  int r = 0;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      r = 1;
+      break;
+    }
+  }
+  release(&bcache.lock);
+  return r;
+}
+
 // Return a locked buf with the contents of the indicated block.
+// On a device that maps its blocks, b->data is the block itself,
+// so nothing is copied, and changes to it are already on the
+// device.
 struct buf*
 bread(uint dev, uint blockno)
 {
   struct buf *b;
+  struct bdevsw *d = bdev(dev);
 
   b = bget(dev, blockno);
   if(!b->valid) {
-    virtio_disk_rw(b, 0);
+    if(d->map)
+      b->data = d->map(dev, blockno);
+    else
+      d->rw(b, 0);
     b->valid = 1;
   }
   return b;
@@ -106,9 +186,13 @@ bread(uint dev, uint blockno)
 void
 bwrite(struct buf *b)
 {
+  struct bdevsw *d;
+
   if(!holdingsleep(&b->lock))
     panic("bwrite");
-  virtio_disk_rw(b, 1);
+  d = bdev(b->dev);
+  if(d->map == 0)
+    d->rw(b, 1);
 }
 
 // Release a locked buffer.
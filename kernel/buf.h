@@ -7,6 +7,20 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  uchar *data; // BSIZE bytes: mem, or the block itself (bdevsw map)
+  uchar *mem;  // b's own BSIZE bytes; a whole page when BSIZE == PGSIZE
 };
 
+// block device switch: how bio.c and fs.c reach each disk,
+// indexed by device number.
+struct bdevsw {
+  uint64 (*nblocks)(uint dev);  // size in BSIZE blocks
+  void (*rw)(struct buf *b, int write);
+  void (*rw_direct)(uint dev, uint blockno, uint64 pa, uint len, int write);
+  // if set, the block's memory, used as b->data in place of
+  // reading and writing it with rw.
+  uchar *(*map)(uint dev, uint blockno);
+};
+
+extern struct bdevsw bdevsw[];
+
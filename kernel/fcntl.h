@@ -3,3 +3,14 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_DIRECT  0x800
+
+// Directory fd meaning "the current directory" for the *at() calls.
+#define AT_FDCWD  -100
+
+// lseek() whence values.
+#define SEEK_SET  0  // offset from start of file
+#define SEEK_CUR  1  // offset from current position
+#define SEEK_END  2  // offset from end of file
+#define SEEK_DATA 3  // next data at or after offset
+#define SEEK_HOLE 4  // next hole at or after offset
@@ -11,6 +11,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "uio.h"
+#include "fcntl.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
@@ -22,7 +24,11 @@ struct {
 void
 fileinit(void)
 {
+  struct file *f;
+
   initlock(&ftable.lock, "ftable");
+  for(f = ftable.file; f < ftable.file + NFILE; f++)
+    initsleeplock(&f->offlock, "fileoff");
 }
 
 // Allocate a file structure.
@@ -91,9 +97,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -101,32 +107,286 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Read up to n entries from directory f, starting at f->off, into
+// the user array of struct dirstat at addr. Unused slots are
+// skipped. If withstat is 1, each entry's inode is looked up too.
+// Returns the number of entries read, 0 at the end of the directory.
+int
+filegetdents(struct file *f, uint64 addr, int n, int withstat)
+{
+  struct proc *p = myproc();
+  struct dirent de;
+  struct dirstat ds;
+  struct inode *ip;
+  int i = 0;
+
+  if(f->type != FD_INODE || f->readable == 0)
+    return -1;
+
+  while(i < n){
+    ilock(f->ip);
+    if(f->ip->type != T_DIR){
+      iunlock(f->ip);
+      return -1;
+    }
+    if(readi(f->ip, 0, (uint64)&de, f->off, sizeof(de)) != sizeof(de)){
+      iunlock(f->ip);
+      break;
+    }
+    f->off += sizeof(de);
+    if(de.inum == 0){
+      iunlock(f->ip);
+      continue;
+    }
+    memset(&ds, 0, sizeof(ds));
+    memmove(ds.name, de.name, DIRSIZ);
+    ds.st.dev = f->ip->dev;
+    ds.st.ino = de.inum;
+    // take a reference while the entry is known to exist, but
+    // lock the inode only after unlocking the directory, since
+    // it may be the directory itself or its parent.
+    ip = 0;
+    if(withstat && (ip = iget(f->ip->dev, de.inum)) == 0){
+      // no memory for the inode; leave the entry for next time.
+      f->off -= sizeof(de);
+      iunlock(f->ip);
+      return i > 0 ? i : -1;
+    }
+    iunlock(f->ip);
+
+    if(ip){
+      ilock(ip);
+      stati(ip, &ds.st);
+      iunlock(ip);
+      begin_op();
+      iput(ip);
+      end_op();
+    }
+    if(copyout(p->pagetable, addr + i*sizeof(ds), (char*)&ds, sizeof(ds)) < 0)
+      return i > 0 ? i : -1;
+    i++;
+  }
+  return i;
+}
+
+// Move f's offset according to off and whence (SEEK_*).
+// Returns the new offset, or -1.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int r;
+
+  if(f->type != FD_INODE)
+    return -1;
+
+  ilock(f->ip);
+  switch(whence){
+  case SEEK_SET:
+    r = off;
+    break;
+  case SEEK_CUR:
+    r = f->off + off;
+    break;
+  case SEEK_END:
+    r = f->ip->size + off;
+    break;
+  case SEEK_DATA:
+  case SEEK_HOLE:
+    if(off < 0 || off >= f->ip->size){
+      r = -1;
+      break;
+    }
+    r = iseek(f->ip, off, whence == SEEK_HOLE);
+    if(whence == SEEK_DATA && r == f->ip->size)
+      r = -1;  // only holes from off to the end
+    break;
+  default:
+    r = -1;
+  }
+  if(r >= 0)
+    f->off = r;
+  iunlock(f->ip);
+  return r < 0 ? -1 : r;
+}
+
+// Read from file f into the iovcnt buffers described by iov,
+// filling each before moving on to the next. The buffers are in
+// user space if user_dst is 1, and in the kernel otherwise. Reads
+// at offset off, or at f->off, advancing it, if off is -1; only
+// inodes can be read at an explicit offset.
+// Returns the number of bytes read.
+int
+filereadv(struct file *f, int user_dst, struct iovec *iov, int iovcnt, int off)
+{
+  int i, r = 0, tot = 0;
+  uint o;
+
+  if(f->readable == 0)
+    return -1;
+  if(off != -1 && (off < 0 || f->type != FD_INODE))
+    return -1;
+
+  // readers of an inode share its lock. Readers at f->off also
+  // hold f->offlock, so that two of them (threads, or processes
+  // that share f) do not both read at and advance the same
+  // offset; writers and lseek() change f->off only under the
+  // inode lock, which excludes readers.
+  if(f->type == FD_INODE){
+    if(off == -1)
+      acquiresleep(&f->offlock);
+    ilockshared(f->ip);
+  }
+  o = (off == -1 ? f->off : off);
+  for(i = 0; i < iovcnt; i++){
+    uint64 addr = (uint64)iov[i].iov_base;
+    int n = iov[i].iov_len;
+
+    if(f->type == FD_PIPE){
+      r = piperead(f->pipe, user_dst, addr, n);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+        return -1;
+      r = devsw[f->major].read(user_dst, addr, n);
+    } else if(f->type == FD_INODE){
+      if((r = readi(f->ip, user_dst, addr, o, n)) > 0)
+        o += r;
+    } else {
+      panic("fileread");
+    }
+    if(r < 0){
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < n)
+      break;
+  }
+  if(f->type == FD_INODE){
+    if(off == -1)
+      f->off = o;
+    iunlockshared(f->ip);
+    if(off == -1)
+      releasesleep(&f->offlock);
+  }
+
+  return tot;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  struct iovec iov;
 
-  if(f->readable == 0)
-    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filereadv(f, 1, &iov, 1, -1);
+}
 
-  if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
-      return -1;
-    r = devsw[f->major].read(1, addr, n);
-  } else if(f->type == FD_INODE){
+// Write n bytes from addr to inode file f at *poff, advancing
+// *poff as the data goes in. addr is a user virtual address if
+// user_src is 1, and a kernel address otherwise.
+// Returns n, or -1 if not all of it could be written.
+static int
+writeinode(struct file *f, int user_src, uint64 addr, int n, uint *poff)
+{
+  int r;
+
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i = 0;
+  while(i < n){
+    int n1, direct;
+
+    begin_op();
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    n1 = n - i;
+    direct = f->direct && user_src && *poff % BSIZE == 0 && n1 >= BSIZE;
+    if(direct){
+      // O_DIRECT: whole blocks bypass the buffer cache and
+      // the log, so it is the metadata that limits how much
+      // fits in a transaction; writei_direct() stops short
+      // when that is full. any tail goes through writei()
+      // next time around. kernel buffers (from splice)
+      // always use the cache.
+      n1 -= n1 % BSIZE;
+    } else {
+      if(n1 > max)
+        n1 = max;
+      // an O_DIRECT write that starts mid-block goes
+      // through the cache only up to the block boundary.
+      if(f->direct && user_src && *poff % BSIZE != 0 && n1 > BSIZE - *poff % BSIZE)
+        n1 = BSIZE - *poff % BSIZE;
+    }
+    if(direct)
+      r = writei_direct(f->ip, addr + i, *poff, n1);
+    else
+      r = writei(f->ip, user_src, addr + i, *poff, n1);
+    if(r > 0)
+      *poff += r;
     iunlock(f->ip);
-  } else {
-    panic("fileread");
+    end_op();
+
+    if(r <= 0 || (r != n1 && !direct)){
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return (i == n ? n : -1);
+}
+
+// Write the iovcnt buffers described by iov to file f, in order.
+// The buffers are in user space if user_src is 1, and in the
+// kernel otherwise. Writes at offset off, or at f->off, advancing
+// it, if off is -1; only inodes can be written at an explicit
+// offset. Returns the number of bytes written, stopping at the
+// first buffer that could not be written in full.
+int
+filewritev(struct file *f, int user_src, struct iovec *iov, int iovcnt, int off)
+{
+  int i, r = 0, tot = 0;
+  uint o;
+
+  if(f->writable == 0)
+    return -1;
+  if(off != -1 && (off < 0 || f->type != FD_INODE))
+    return -1;
+
+  o = off;
+  for(i = 0; i < iovcnt; i++){
+    uint64 addr = (uint64)iov[i].iov_base;
+    int n = iov[i].iov_len;
+
+    if(f->type == FD_PIPE){
+      r = pipewrite(f->pipe, user_src, addr, n);
+    } else if(f->type == FD_DEVICE){
+      if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+        return -1;
+      r = devsw[f->major].write(user_src, addr, n);
+    } else if(f->type == FD_INODE){
+      r = writeinode(f, user_src, addr, n, off == -1 ? &f->off : &o);
+    } else {
+      panic("filewrite");
+    }
+    if(r < 0){
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < n)
+      break;
   }
 
-  return r;
+  return tot;
 }
 
 // Write to file f.
@@ -134,49 +394,69 @@ fileread(struct file *f, uint64 addr, int n)
 int
 filewrite(struct file *f, uint64 addr, int n)
 {
-  int r, ret = 0;
+  struct iovec iov;
 
-  if(f->writable == 0)
-    return -1;
+  iov.iov_base = (void*)addr;
+  iov.iov_len = n;
+  return filewritev(f, 1, &iov, 1, -1);
+}
 
-  if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
-  } else if(f->type == FD_DEVICE){
-    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
-      return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+// Move up to n bytes from file in to file out without going
+// through user space, a page at a time. Reads at *inoff and
+// writes at *outoff, advancing them, or at the files' own
+// offsets if those pointers are null. Stops early at end of
+// file, after a short read from a pipe or device, or after a
+// short write; then an inode's input offset is moved back over
+// what was read but not written, which a pipe or device cannot
+// take back.
+// Returns the number of bytes moved, or -1 if none could be.
+int
+filesplice(struct file *in, int *inoff, struct file *out, int *outoff, int n)
+{
+  int r, w, m, tot = 0;
+  struct iovec iov;
+  char *buf;
 
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if((buf = kalloc()) == 0)
+    return -1;
 
-      if(r != n1){
-        // error from writei
-        break;
-      }
-      i += r;
+  iov.iov_base = buf;
+  while(tot < n){
+    m = n - tot;
+    if(m > PGSIZE)
+      m = PGSIZE;
+    iov.iov_len = m;
+    if((r = filereadv(in, 0, &iov, 1, inoff ? *inoff : -1)) <= 0){
+      if(r < 0 && tot == 0)
+        tot = -1;
+      break;
     }
-    ret = (i == n ? n : -1);
-  } else {
-    panic("filewrite");
+    if(inoff)
+      *inoff += r;
+
+    iov.iov_len = r;
+    w = filewritev(out, 0, &iov, 1, outoff ? *outoff : -1);
+    if(w > 0 && outoff)
+      *outoff += w;
+    if(w != r){
+      if(w < 0)
+        w = 0;
+      if(inoff)
+        *inoff -= r - w;
+      else if(in->type == FD_INODE)
+        fileseek(in, w - r, SEEK_CUR);
+      tot += w;
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    tot += r;
+    if(r < m)
+      break;
   }
 
-  return ret;
+  kfree(buf);
+  return tot;
 }
-
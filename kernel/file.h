@@ -3,9 +3,11 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char direct;       // FD_INODE opened O_DIRECT
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
+  struct sleeplock offlock; // serializes readers at off
   short major;       // FD_DEVICE
 };
 
@@ -18,6 +20,8 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *prev; // inode table hash chain, LRU order
+  struct inode *next;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -13,6 +13,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "stat.h"
 #include "spinlock.h"
 #include "proc.h"
@@ -22,9 +23,12 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
-// there should be one superblock per disk device, but we run with
-// only one device
-struct superblock sb; 
+// one superblock per disk device, read by fsinit().
+struct superblock sb[NDISK];
+#define SB(dev) (sb[(dev) - ROOTDEV])
+
+// serializes fsinit(), which mount() may call at any time.
+static struct sleeplock fsinitlock;
 
 // Read the super block.
 static void
@@ -37,13 +41,44 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
-// Init fs
-void
+// Read disk dev's superblock and recover its log.
+static int
+fsinit1(int dev)
+{
+  struct superblock *s = &SB(dev);
+
+  if(bnblocks(dev) == 0)
+    return -1;
+  readsb(dev, s);
+  if(s->magic != FSMAGIC){
+    printf("fsinit: dev %d: invalid file system\n", dev);
+    return -1;
+  }
+  if(s->bsize != BSIZE){
+    printf("fsinit: dev %d: block size differs from BSIZE\n", dev);
+    return -1;
+  }
+  if(s->size > bnblocks(dev)){
+    printf("fsinit: dev %d: file system larger than disk\n", dev);
+    return -1;
+  }
+  initlog(dev, s);
+  return 0;
+}
+
+// Init fs on disk dev, the first time it is used.
+// Returns -1 if dev has no usable file system.
+int
 fsinit(int dev) {
-  readsb(dev, &sb);
-  if(sb.magic != FSMAGIC)
-    panic("invalid file system");
-  initlog(dev, &sb);
+  static char ready[NDISK];
+  int r;
+
+  acquiresleep(&fsinitlock);
+  if(!ready[dev - ROOTDEV] && fsinit1(dev) == 0)
+    ready[dev - ROOTDEV] = 1;
+  r = ready[dev - ROOTDEV] ? 0 : -1;
+  releasesleep(&fsinitlock);
+  return r;
 }
 
 // Zero a block.
@@ -60,31 +95,86 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
+// Where balloc() last found a free block on each disk, so that
+// on a large disk the search does not start over at the first
+// bitmap block every time. Only a hint: racing updates are harmless.
+static uint brotor[NDISK];
+
+// Allocate a disk block without zeroing it. A block that
+// is to be written outside the log (direct) must not come
+// from a bitmap block in which something was freed in the
+// open transaction, nor have a copy in the buffer cache that
+// the write would leave stale; if there is no such block,
+// return 0 instead of panicking.
 static uint
-balloc(uint dev)
+ballocraw(uint dev, int direct)
 {
-  int b, bi, m;
+  int b, bi, i, m, nmap;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+  nmap = (SB(dev).size + BPB - 1) / BPB;
+  for(i = 0; i < nmap; i++){
+    b = ((brotor[dev - ROOTDEV] / BPB + i) % nmap) * BPB;
+    if(direct && log_bfreed(dev, b))
+      continue;
+    bp = bread(dev, BBLOCK(b, SB(dev)));
+    for(bi = 0; bi < BPB && b + bi < SB(dev).size; bi++){
+      if(bp->data[bi/8] == 0xff){  // whole byte in use
+        bi |= 7;
+        continue;
+      }
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      if((bp->data[bi/8] & m) == 0 && !(direct && bcached(dev, b + bi))){
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
         brelse(bp);
-        bzero(dev, b + bi);
+        brotor[dev - ROOTDEV] = b + bi;
         return b + bi;
       }
     }
     brelse(bp);
   }
+  if(direct)
+    return 0;
   panic("balloc: out of blocks");
 }
 
+// Allocate a zeroed disk block.
+static uint
+balloc(uint dev)
+{
+  uint b;
+
+  b = ballocraw(dev, 0);
+  bzero(dev, b);
+  return b;
+}
+
+// Allocate block b, unzeroed, for a direct write if it is
+// free and ballocraw(dev, 1) could have returned it, so that
+// a run of new blocks goes to the disk in one request.
+// Returns 1 if b is now allocated, 0 if not.
+static int
+ballocat(uint dev, uint b)
+{
+  struct buf *bp;
+  int bi, m, r;
+
+  if(b >= SB(dev).size || log_bfreed(dev, b) || bcached(dev, b))
+    return 0;
+  bp = bread(dev, BBLOCK(b, SB(dev)));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  r = 0;
+  if((bp->data[bi/8] & m) == 0){
+    bp->data[bi/8] |= m;
+    log_write(bp);
+    r = 1;
+  }
+  brelse(bp);
+  return r;
+}
+
 // Free a disk block.
 static void
 bfree(int dev, uint b)
@@ -92,7 +182,7 @@ bfree(int dev, uint b)
   struct buf *bp;
   int bi, m;
 
-  bp = bread(dev, BBLOCK(b, sb));
+  bp = bread(dev, BBLOCK(b, SB(dev)));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
@@ -100,6 +190,7 @@ bfree(int dev, uint b)
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  log_bfree(dev, b);
 }
 
 // Inodes.
@@ -128,9 +219,9 @@ bfree(int dev, uint b)
 //   the reference and link counts have fallen to zero.
 //
 // * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
+//   may be recycled if ip->ref is zero. Otherwise ip->ref
+//   tracks the number of in-memory pointers to the entry
+//   (open files and current directories). iget() finds or
 //   creates a table entry and increments its ref; iput()
 //   decrements ref.
 //
@@ -138,7 +229,8 @@ bfree(int dev, uint b)
 //   table entry is only correct when ip->valid is 1.
 //   ilock() reads the inode from
 //   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ip->valid if it frees the inode on disk and iget()
+//   clears it when it recycles an entry.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,52 +254,147 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// The inode table is a hash table keyed by (dev, inum). Each
+// bucket has a spin-lock that protects the bucket's list and, for
+// every inode on that list, ip->ref, ip->dev and ip->inum; one must
+// hold the bucket lock while using any of those fields. Since dev
+// and inum do not change while ip->ref > 0, idup() and iput() can
+// find the right bucket without further locking.
+//
+// Entries whose ref has fallen to zero stay in their bucket,
+// still valid, so that a later iget() of a hot inode does not
+// have to read it from disk again. Each bucket list is kept in
+// least-recently-released order, and iget() recycles the oldest
+// unreferenced entry only once NINODE entries exist; otherwise,
+// or if every entry is referenced, the table grows by another
+// page of inodes.
+//
+// itable.lock serializes the slow path of iget() (allocation,
+// recycling, growth) and protects itable.free and itable.ninode.
+// It is acquired before any bucket lock, and only the holder of
+// itable.lock ever holds two bucket locks at once.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, next and prev.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
+// ilockshared() lets any number of processes hold it at once
+// to read, but not change, those fields and the inode's content.
+
+#define NIBUCKET 13
+#define IHASH(dev, inum) (((dev) * 31 + (inum)) % NIBUCKET)
+
+struct ibucket {
+  struct spinlock lock;
+  // most recently released at head.next, least at head.prev.
+  struct inode head;
+};
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct ibucket bucket[NIBUCKET];
+  struct inode *free;  // never-used entries, linked through next
+  int ninode;          // entries allocated so far
+  int hand;            // next bucket to look in for a victim
 } itable;
 
+static void dcacheinit(void);
+static void dcachepurge(uint, uint);
+static void dcachepurgedev(uint);
+static void mountinit(void);
+
 void
 iinit()
 {
-  int i = 0;
-  
+  struct ibucket *bk;
+
+  dcacheinit();
+  mountinit();
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  for(bk = itable.bucket; bk < &itable.bucket[NIBUCKET]; bk++){
+    initlock(&bk->lock, "itable.bucket");
+    bk->head.prev = &bk->head;
+    bk->head.next = &bk->head;
   }
 }
 
-static struct inode* iget(uint dev, uint inum);
+// Where ialloc() last found a free inode; see brotor.
+static uint irotor[NDISK];
+
+// Mark inode inum free in the inode bitmap.
+static void
+ifree(uint dev, uint inum)
+{
+  struct buf *bp;
+  int bi, m;
+
+  if(dev == TMPDEV)
+    return;  // iupdate() with type 0 freed it.
+
+  bp = bread(dev, IMBLOCK(inum, SB(dev)));
+  bi = inum % BPB;
+  m = 1 << (bi % 8);
+  if((bp->data[bi/8] & m) == 0)
+    panic("freeing free inode");
+  bp->data[bi/8] &= ~m;
+  log_write(bp);
+  brelse(bp);
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
+// Returns an unlocked but allocated and referenced inode,
+// or 0 if tmpfs has no inodes left or there is no memory
+// for the in-memory inode.
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int b, bi, i, m, nmap;
+  uint inum;
   struct buf *bp;
   struct dinode *dip;
+  struct inode *ip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+  if(dev == TMPDEV){
+    if((inum = tmpialloc(type)) == 0)
+      return 0;
+    if((ip = iget(dev, inum)) == 0)
+      tmpifree(inum);
+    return ip;
+  }
+
+  // Look through the inode bitmap, one block at a time,
+  // starting with the block that holds the rotor.
+  nmap = (SB(dev).ninodes + BPB - 1) / BPB;
+  for(i = 0; i < nmap; i++){
+    b = ((irotor[dev - ROOTDEV] / BPB + i) % nmap) * BPB;
+    bp = bread(dev, IMBLOCK(b, SB(dev)));
+    for(bi = 0; bi < BPB && b + bi < SB(dev).ninodes; bi++){
+      if(bp->data[bi/8] == 0xff){  // whole byte in use
+        bi |= 7;
+        continue;
+      }
+      m = 1 << (bi % 8);
+      if((bp->data[bi/8] & m) == 0){  // Is inode free?
+        bp->data[bi/8] |= m;  // Mark inode in use.
+        log_write(bp);
+        brelse(bp);
+        inum = b + bi;
+        irotor[dev - ROOTDEV] = inum;
+        if((ip = iget(dev, inum)) == 0){
+          ifree(dev, inum);
+          return 0;
+        }
+
+        bp = bread(dev, IBLOCK(inum, SB(dev)));
+        dip = (struct dinode*)bp->data + inum%IPB;
+        if(dip->type != 0)
+          panic("ialloc: inode map");
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        return ip;
+      }
     }
     brelse(bp);
   }
@@ -224,7 +411,12 @@ iupdate(struct inode *ip)
   struct buf *bp;
   struct dinode *dip;
 
-  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  if(ip->dev == TMPDEV){
+    tmpiupdate(ip);
+    return;
+  }
+
+  bp = bread(ip->dev, IBLOCK(ip->inum, SB(ip->dev)));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
   dip->major = ip->major;
@@ -236,37 +428,135 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+static void
+iunlink(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
+// Insert ip at the most-recently-used end of bucket bk.
+static void
+ilinkhead(struct ibucket *bk, struct inode *ip)
+{
+  ip->next = bk->head.next;
+  ip->prev = &bk->head;
+  bk->head.next->prev = ip;
+  bk->head.next = ip;
+}
+
+// Look for (dev, inum) in bucket bk, which must be locked.
+// Takes a reference on success.
+static struct inode*
+ifind(struct ibucket *bk, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = bk->head.next; ip != &bk->head; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
+      ip->ref++;
+      return ip;
+    }
+  }
+  return 0;
+}
+
+// Add a page worth of fresh entries to itable.free.
+// Caller must hold itable.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  char *pg;
+
+  if((pg = kalloc()) == 0)
+    return -1;
+  memset(pg, 0, PGSIZE);
+  for(ip = (struct inode*)pg; ip + 1 <= (struct inode*)(pg + PGSIZE); ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->next = itable.free;
+    itable.free = ip;
+    itable.ninode++;
+  }
+  return 0;
+}
+
+// Take the least recently released unreferenced entry out of the
+// first bucket, starting at itable.hand, that has one.
+// Caller must hold itable.lock and the lock of bucket held.
+static struct inode*
+ievict(struct ibucket *held)
+{
+  struct ibucket *bk;
+  struct inode *ip;
+  int i;
+
+  for(i = 0; i < NIBUCKET; i++){
+    bk = &itable.bucket[itable.hand];
+    itable.hand = (itable.hand + 1) % NIBUCKET;
+    if(bk != held)
+      acquire(&bk->lock);
+    for(ip = bk->head.prev; ip != &bk->head; ip = ip->prev){
+      if(ip->ref == 0){
+        iunlink(ip);
+        if(bk != held)
+          release(&bk->lock);
+        return ip;
+      }
+    }
+    if(bk != held)
+      release(&bk->lock);
+  }
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+// Returns 0 if there is no memory for another inode.
+struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct ibucket *bk = &itable.bucket[IHASH(dev, inum)];
+  struct inode *ip;
+
+  // Is the inode already in the table?
+  acquire(&bk->lock);
+  if((ip = ifind(bk, dev, inum)) != 0){
+    release(&bk->lock);
+    return ip;
+  }
+  release(&bk->lock);
 
+  // Not cached. Serialize with other allocators and look again,
+  // since one of them may have added it in the meantime.
   acquire(&itable.lock);
+  acquire(&bk->lock);
+  if((ip = ifind(bk, dev, inum)) != 0){
+    release(&bk->lock);
+    release(&itable.lock);
+    return ip;
+  }
 
-  // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  ip = 0;
+  if(itable.free == 0 && itable.ninode >= NINODE)
+    ip = ievict(bk);
+  if(ip == 0){
+    if(itable.free == 0 && igrow() < 0){
+      release(&bk->lock);
       release(&itable.lock);
-      return ip;
+      return 0;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+    ip = itable.free;
+    itable.free = ip->next;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ilinkhead(bk, ip);
+  release(&bk->lock);
   release(&itable.lock);
 
   return ip;
@@ -277,9 +567,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *bk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&bk->lock);
   ip->ref++;
-  release(&itable.lock);
+  release(&bk->lock);
   return ip;
 }
 
@@ -296,8 +588,13 @@ ilock(struct inode *ip)
 
   acquiresleep(&ip->lock);
 
-  if(ip->valid == 0){
-    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  if(ip->valid == 0 && ip->dev == TMPDEV){
+    tmpiread(ip);
+    ip->valid = 1;
+    if(ip->type == 0)
+      panic("ilock: no type");
+  } else if(ip->valid == 0){
+    bp = bread(ip->dev, IBLOCK(ip->inum, SB(ip->dev)));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
     ip->major = dip->major;
@@ -322,9 +619,38 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode for reading only: any number of
+// processes can hold it this way at once, excluding ilock().
+// The holder may read ip's fields and content (readi()) but
+// must not change them, and must not lock ip again.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    // reading the inode in from disk writes to it.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
-// be recycled.
+// be recycled, but it stays cached until then.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -332,7 +658,9 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *bk = &itable.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&bk->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,20 +669,27 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&bk->lock);
 
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
+    ifree(ip->dev, ip->inum);
+    dcachepurge(ip->dev, ip->inum);
     ip->valid = 0;
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(&bk->lock);
   }
 
   ip->ref--;
-  release(&itable.lock);
+  if(ip->ref == 0){
+    // keep it cached; most recently released goes first.
+    iunlink(ip);
+    ilinkhead(bk, ip);
+  }
+  release(&bk->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -404,6 +739,76 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Return the disk block address of the nth block in inode ip,
+// or 0 if that part of the file is a hole. Never allocates, so
+// reading a sparse file costs no disk space.
+static uint
+bmapped(struct inode *ip, uint bn)
+{
+  uint addr;
+  struct buf *bp;
+
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    if((addr = ip->addrs[NDIRECT]) == 0)
+      return 0;
+    bp = bread(ip->dev, addr);
+    addr = ((uint*)bp->data)[bn];
+    brelse(bp);
+    return addr;
+  }
+
+  panic("bmapped: out of range");
+}
+
+// Make addr, a block just allocated, the nth block of ip,
+// which must be a hole.
+static void
+bmapset(struct inode *ip, uint bn, uint addr)
+{
+  uint ind;
+  struct buf *bp;
+
+  if(bn < NDIRECT){
+    ip->addrs[bn] = addr;
+    return;
+  }
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    if((ind = ip->addrs[NDIRECT]) == 0)
+      ip->addrs[NDIRECT] = ind = balloc(ip->dev);
+    bp = bread(ip->dev, ind);
+    ((uint*)bp->data)[bn] = addr;
+    log_write(bp);
+    brelse(bp);
+    return;
+  }
+
+  panic("bmapset: out of range");
+}
+
+// Return the first offset at or after off that lies in a block
+// holding data, or, if hole is 1, in a hole. The end of the file
+// counts as a hole, and is returned if nothing else is found.
+// Caller must hold ip->lock.
+uint
+iseek(struct inode *ip, uint off, int hole)
+{
+  uint bn;
+
+  if(ip->dev == TMPDEV)
+    return tmpiseek(ip, off, hole);
+  for(bn = off / BSIZE; bn * BSIZE < ip->size; bn++){
+    if((bmapped(ip, bn) == 0) == hole)
+      return bn * BSIZE > off ? bn * BSIZE : off;
+  }
+  return ip->size;
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -413,6 +818,11 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->dev == TMPDEV){
+    tmpitrunc(ip);
+    return;
+  }
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -448,24 +858,83 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Read whole blocks of ip starting at block-aligned offset off
+// straight from the disk into dst, skipping the buffer cache and
+// the copy out of it. Handles at most one run of blocks that are
+// consecutive on disk, not cached, and land in physically
+// contiguous memory. Returns the number of bytes read, or 0 if
+// the next block has to go through the buffer cache instead.
+// Caller must hold ip->lock, which keeps the blocks from
+// entering the cache or being written meanwhile.
+static uint
+readi_direct(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint64 pa;
+  uint addr, bn, k, max;
+
+  if(user_dst){
+    if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(dst))) == 0)
+      return 0;
+    pa += dst % PGSIZE;
+    max = PGSIZE - dst % PGSIZE;
+  } else {
+    // only the direct-mapped part of the kernel's address
+    // space has kernel virtual == physical addresses.
+    if(dst < KERNBASE || dst + n > PHYSTOP)
+      return 0;
+    pa = dst;
+    max = n;
+  }
+  if(max > n)
+    max = n;
+
+  bn = off / BSIZE;
+  if((addr = bmapped(ip, bn)) == 0)
+    return 0;
+  for(k = 0; (k+1)*BSIZE <= max; k++){
+    if(bmapped(ip, bn + k) != addr + k || bcached(ip->dev, addr + k))
+      break;
+  }
+  if(k == 0)
+    return 0;
+
+  brw_direct(ip->dev, addr, pa, k*BSIZE, 0);
+  return k*BSIZE;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// Large block-aligned reads go straight from the disk to dst,
+// and holes read as zeroes.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  static char zeroes[BSIZE];
+  uint tot, m, addr;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
     return 0;
   if(off + n > ip->size)
     n = ip->size - off;
+  if(ip->dev == TMPDEV)
+    return tmpreadi(ip, user_dst, dst, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(off % BSIZE == 0 && n - tot >= BSIZE &&
+       (m = readi_direct(ip, user_dst, dst, off, n - tot)) > 0)
+      continue;
     m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmapped(ip, off/BSIZE)) == 0){
+      if(either_copyout(user_dst, dst, zeroes, m) == -1) {
+        tot = -1;
+        break;
+      }
+      continue;
+    }
+    bp = bread(ip->dev, addr);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
       tot = -1;
@@ -480,6 +949,8 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
 // otherwise, src is a kernel address.
+// Writing past the end of the file leaves a hole, which
+// takes no blocks until something is written into it.
 // Returns the number of bytes successfully written.
 // If the return value is less than the requested n,
 // there was an error of some kind.
@@ -489,7 +960,9 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   uint tot, m;
   struct buf *bp;
 
-  if(off > ip->size || off + n < off)
+  if(ip->dev == TMPDEV)
+    return tmpwritei(ip, user_src, src, off, n);
+  if(off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
@@ -505,7 +978,9 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     brelse(bp);
   }
 
-  if(off > ip->size)
+  // only data written extends the file: a write of nothing
+  // past the end leaves the size alone.
+  if(tot > 0 && off > ip->size)
     ip->size = off;
 
   // write the i-node back to disk even if the size didn't change
@@ -516,6 +991,112 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Count in *nlog the log block for the bitmap block that
+// marks b allocated, unless it is *bm, counted already.
+static void
+countbm(uint dev, uint b, uint *bm, int *nlog)
+{
+  if(BBLOCK(b, SB(dev)) != *bm){
+    *bm = BBLOCK(b, SB(dev));
+    *nlog += 1;
+  }
+}
+
+// Write n bytes, a multiple of BSIZE, from user address src to
+// ip at block-aligned offset off, for O_DIRECT. Data blocks go
+// straight from the user's pages to the disk, new ones too;
+// only the inode, indirect block and bitmap are logged. The
+// data is on the disk before the transaction that allocates its
+// blocks commits. A block that may have been freed earlier in
+// this same open transaction is never written directly, since a
+// crash would give it back to its old owner with the new data.
+// Nor is a block with a copy in the buffer cache, which the log
+// might later install over it. Those blocks, and ones the
+// user's pages do not map whole, are written through the log
+// like writei()'s; a new one is zeroed only if copying into it
+// fails. Stops short, rather than overflow the transaction,
+// once MAXOPBLOCKS blocks may have been logged.
+// Caller must hold ip->lock and be inside a transaction.
+// Returns the number of bytes written, like writei().
+int
+writei_direct(struct inode *ip, uint64 src, uint off, uint n)
+{
+  uint tot, m, bn, addr, a, k, bm;
+  uint64 pa;
+  struct buf *bp;
+  int nlog, fresh;
+
+  if(off % BSIZE != 0 || n % BSIZE != 0)
+    panic("writei_direct");
+  if(ip->dev == TMPDEV)
+    return writei(ip, 1, src, off, n);
+  if(off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+
+  // the inode, the indirect block, and the bitmap
+  // block of the indirect block if it is new.
+  nlog = 3;
+  bm = 0;
+  for(tot=0; tot<n && nlog + 2 <= MAXOPBLOCKS; tot+=m, off+=m, src+=m){
+    bn = off / BSIZE;
+    fresh = 0;
+    addr = bmapped(ip, bn);
+    pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(src));
+    if(pa != 0 && src % PGSIZE + BSIZE <= PGSIZE){
+      if(addr == 0 && (addr = ballocraw(ip->dev, 1)) != 0){
+        bmapset(ip, bn, addr);
+        countbm(ip->dev, addr, &bm, &nlog);
+        fresh = 1;
+      }
+      if(addr != 0 && !bcached(ip->dev, addr) && !log_bfreed(ip->dev, addr)){
+        for(k = 1; tot + (k+1)*BSIZE <= n && src % PGSIZE + (k+1)*BSIZE <= PGSIZE; k++){
+          a = bmapped(ip, bn + k);
+          // a new block must not start another bitmap block,
+          // which the transaction may have no room for.
+          if(a == 0 && (addr + k) % BPB != 0 && ballocat(ip->dev, addr + k)){
+            bmapset(ip, bn + k, addr + k);
+            countbm(ip->dev, addr + k, &bm, &nlog);
+            a = addr + k;
+          }
+          if(a != addr + k || bcached(ip->dev, a) || log_bfreed(ip->dev, a))
+            break;
+        }
+        m = k*BSIZE;
+        brw_direct(ip->dev, addr, pa + src % PGSIZE, m, 1);
+        continue;
+      }
+    }
+
+    m = BSIZE;
+    if(addr == 0){
+      addr = ballocraw(ip->dev, 0);
+      bmapset(ip, bn, addr);
+      countbm(ip->dev, addr, &bm, &nlog);
+      fresh = 1;
+    }
+    bp = bread(ip->dev, addr);
+    if(either_copyin(bp->data, 1, src, m) == -1) {
+      if(fresh){
+        memset(bp->data, 0, BSIZE);
+        log_write(bp);
+      }
+      brelse(bp);
+      break;
+    }
+    log_write(bp);
+    brelse(bp);
+    nlog++;
+  }
+
+  if(tot > 0 && off > ip->size)
+    ip->size = off;
+  iupdate(ip);
+
+  return tot;
+}
+
 // Directories
 
 int
@@ -524,12 +1105,147 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+// Directory entry cache.
+//
+// Remembers which inode the name in directory (dev, parent)
+// refers to, so that namex() can step through a directory
+// without locking it. Each entry is a seqlock: writers, which
+// are serialized by dcache.lock, make seq odd while they change
+// the entry, and readers retry through the locked path if seq
+// was odd or changed while they looked. The cache is
+// direct-mapped; an entry is simply overwritten on collision.
+//
+// Anything that removes or changes a name in a directory
+// must call dcacheforget() while holding the directory's lock,
+// and iput() purges a freed inode's entries, including the "."
+// and ".." of a removed directory, before its number is reused.
+
+struct dentry {
+  uint seq;
+  uint dev;
+  uint parent;      // inode number of directory
+  uint inum;        // 0 if entry is unused
+  char name[DIRSIZ];
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry ent[NDENTRY];
+} dcache;
+
+static void
+dcacheinit(void)
+{
+  initlock(&dcache.lock, "dcache");
+}
+
+static struct dentry*
+dhash(uint dev, uint parent, char *name)
+{
+  uint h = dev*31 + parent;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return &dcache.ent[h % NDENTRY];
+}
+
+// Set the entry for name in directory (dev, parent) to inum,
+// or clear it if inum is 0.
+static void
+dcacheset(struct dentry *d, uint dev, uint parent, char *name, uint inum)
+{
+  acquire(&dcache.lock);
+  d->seq++;
+  __sync_synchronize();
+  d->dev = dev;
+  d->parent = parent;
+  strncpy(d->name, name, DIRSIZ);
+  d->inum = inum;
+  __sync_synchronize();
+  d->seq++;
+  release(&dcache.lock);
+}
+
+// Look up name in directory dp without locking dp.
+// Returns the named inode, referenced but unlocked, or 0 if
+// the cache can't say for sure. Must be called inside a
+// transaction since it calls iput().
+static struct inode*
+dcachelookup(struct inode *dp, char *name)
+{
+  struct dentry *d = dhash(dp->dev, dp->inum, name);
+  struct inode *ip;
+  uint seq;
+
+  seq = d->seq;
+  __sync_synchronize();
+  if((seq & 1) || d->inum == 0 || d->dev != dp->dev ||
+     d->parent != dp->inum || namecmp(d->name, name) != 0)
+    return 0;
+  // take a reference before re-checking seq: if the entry was
+  // still current then, the inode can't have been freed.
+  if((ip = iget(dp->dev, d->inum)) == 0)
+    return 0;
+  __sync_synchronize();
+  if(d->seq != seq){
+    iput(ip);
+    return 0;
+  }
+  return ip;
+}
+
+// Remember that name in directory dp is inode inum.
+// Caller must hold dp->lock, shared or not.
+static void
+dcacheadd(struct inode *dp, char *name, uint inum)
+{
+  dcacheset(dhash(dp->dev, dp->inum, name), dp->dev, dp->inum, name, inum);
+}
+
+// Forget name in directory dp, if it is cached.
+// Caller must hold dp->lock exclusively.
+void
+dcacheforget(struct inode *dp, char *name)
+{
+  struct dentry *d = dhash(dp->dev, dp->inum, name);
+
+  if(d->inum != 0 && d->dev == dp->dev && d->parent == dp->inum &&
+     namecmp(d->name, name) == 0)
+    dcacheset(d, 0, 0, "", 0);
+}
+
+// Forget every entry in or for inode inum, which is being freed.
+static void
+dcachepurge(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  for(d = dcache.ent; d < &dcache.ent[NDENTRY]; d++){
+    if(d->inum != 0 && d->dev == dev && (d->parent == inum || d->inum == inum))
+      dcacheset(d, 0, 0, "", 0);
+  }
+}
+
+// Forget every entry of device dev, which is being unmounted.
+static void
+dcachepurgedev(uint dev)
+{
+  struct dentry *d;
+
+  for(d = dcache.ent; d < &dcache.ent[NDENTRY]; d++){
+    if(d->inum != 0 && d->dev == dev)
+      dcacheset(d, 0, 0, "", 0);
+  }
+}
+
+// Look for name in directory dp without touching the
+// inode table. If found, set *poff to byte offset of
+// the entry and return its inode number; otherwise 0.
+uint
+dirfind(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off;
   struct dirent de;
 
   if(dp->type != T_DIR)
@@ -544,27 +1260,38 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       // entry matches path element
       if(poff)
         *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+      return de.inum;
     }
   }
 
   return 0;
 }
 
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+// Returns 0 if there is none, or if there is no
+// memory for its inode; callers that must tell
+// these apart use dirfind().
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint inum;
+
+  if((inum = dirfind(dp, name, poff)) == 0)
+    return 0;
+  return iget(dp->dev, inum);
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
   struct dirent de;
-  struct inode *ip;
 
   // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  if(dirfind(dp, name, 0) != 0)
     return -1;
-  }
 
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
@@ -578,6 +1305,7 @@ dirlink(struct inode *dp, char *name, uint inum)
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  dcacheforget(dp, name);
 
   return 0;
 }
@@ -621,37 +1349,241 @@ skipelem(char *path, char *name)
   return path;
 }
 
+// Mounted file systems.
+//
+// mount() attaches the root of another device's file system
+// (a second disk, or tmpfs) to a directory, its mount point.
+// namex() steps from a mount point into the mounted root, and
+// from that root's ".." back up to the mount point's parent.
+// Each entry holds a reference to its mount point. mtable.lock
+// is acquired before any itable lock, so that looking up a
+// mounted root (with iget()) cannot race with umount().
+
+struct mount {
+  struct inode *mntpt;  // 0 if the entry is free
+  uint dev;             // device mounted on it
+};
+
+struct {
+  struct spinlock lock;
+  struct mount mount[NMOUNT];
+} mtable;
+
+static void
+mountinit(void)
+{
+  initlock(&mtable.lock, "mtable");
+  initsleeplock(&fsinitlock, "fsinit");
+}
+
+// If ip is a mount point, drop it and return the root of the
+// file system mounted on it instead, or 0 if there is no
+// memory for that inode.
+static struct inode*
+mountroot(struct inode *ip)
+{
+  struct mount *m;
+  struct inode *root;
+
+  acquire(&mtable.lock);
+  for(m = mtable.mount; m < &mtable.mount[NMOUNT]; m++){
+    if(m->mntpt == ip){
+      root = iget(m->dev, ROOTINO);
+      release(&mtable.lock);
+      iput(ip);
+      return root;
+    }
+  }
+  release(&mtable.lock);
+  return ip;
+}
+
+// If ip is the root of a mounted file system, drop it and
+// return the mount point instead.
+static struct inode*
+mountpoint(struct inode *ip)
+{
+  struct mount *m;
+  struct inode *mntpt;
+
+  if(ip->inum != ROOTINO || ip->dev == ROOTDEV)
+    return ip;
+  acquire(&mtable.lock);
+  for(m = mtable.mount; m < &mtable.mount[NMOUNT]; m++){
+    if(m->mntpt && m->dev == ip->dev){
+      mntpt = idup(m->mntpt);
+      release(&mtable.lock);
+      iput(ip);
+      return mntpt;
+    }
+  }
+  release(&mtable.lock);
+  return ip;
+}
+
+// Is ip a mount point?
+int
+ismountpoint(struct inode *ip)
+{
+  struct mount *m;
+  int r = 0;
+
+  acquire(&mtable.lock);
+  for(m = mtable.mount; m < &mtable.mount[NMOUNT]; m++){
+    if(m->mntpt == ip)
+      r = 1;
+  }
+  release(&mtable.lock);
+  return r;
+}
+
+// Mount dev's file system on directory ip, which must not
+// already be a mount point or the root of a file system.
+// On success the mount table keeps the caller's reference
+// to ip. Returns -1 if ip or dev is unsuitable.
+int
+mount(struct inode *ip, uint dev)
+{
+  struct mount *m, *free = 0;
+
+  ilock(ip);
+  if(ip->type != T_DIR || ip->inum == ROOTINO){
+    iunlock(ip);
+    return -1;
+  }
+  acquire(&mtable.lock);
+  for(m = mtable.mount; m < &mtable.mount[NMOUNT]; m++){
+    if(m->mntpt == 0){
+      if(free == 0)
+        free = m;
+    } else if(m->mntpt == ip || m->dev == dev){
+      free = 0;
+      break;
+    }
+  }
+  if(free){
+    free->mntpt = ip;
+    free->dev = dev;
+  }
+  release(&mtable.lock);
+  iunlock(ip);
+  return free ? 0 : -1;
+}
+
+// Unmount the file system whose root is ip. Fails if any
+// inode of it other than the caller's ip is in use, as by an
+// open file or a current directory. Its names and cached
+// inodes are dropped, so that a later mount of the device
+// starts afresh; ip is marked invalid, to be read again.
+// Must be called inside a transaction since it calls iput().
+int
+umount(struct inode *ip)
+{
+  struct mount *m;
+  struct ibucket *bk;
+  struct inode *mntpt, *p, *next;
+  int busy = 0;
+
+  acquire(&mtable.lock);
+  for(m = mtable.mount; m < &mtable.mount[NMOUNT]; m++){
+    if(m->mntpt && m->dev == ip->dev && ip->inum == ROOTINO)
+      break;
+  }
+  if(m == &mtable.mount[NMOUNT]){
+    release(&mtable.lock);
+    return -1;
+  }
+  for(bk = itable.bucket; bk < &itable.bucket[NIBUCKET]; bk++){
+    acquire(&bk->lock);
+    for(p = bk->head.next; p != &bk->head; p = p->next){
+      if(p->dev == ip->dev && p->ref > (p == ip ? 1 : 0))
+        busy = 1;
+    }
+    release(&bk->lock);
+  }
+  if(busy){
+    release(&mtable.lock);
+    return -1;
+  }
+  mntpt = m->mntpt;
+  m->mntpt = 0;
+  release(&mtable.lock);
+
+  // nothing can reach the device now, and only the caller
+  // holds a reference to any of its inodes.
+  dcachepurgedev(ip->dev);
+  acquire(&itable.lock);
+  for(bk = itable.bucket; bk < &itable.bucket[NIBUCKET]; bk++){
+    acquire(&bk->lock);
+    for(p = bk->head.next; p != &bk->head; p = next){
+      next = p->next;
+      if(p->dev != ip->dev)
+        continue;
+      if(p == ip){
+        p->valid = 0;
+        continue;
+      }
+      iunlink(p);
+      p->next = itable.free;
+      itable.free = p;
+    }
+    release(&bk->lock);
+  }
+  release(&itable.lock);
+
+  iput(mntpt);
+  return 0;
+}
+
 // Look up and return the inode for a path name.
+// Relative paths start at dp, or at the current directory if dp is 0.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 // Must be called inside a transaction since it calls iput().
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *dp, char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
-  if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
+  if(*path == '/'){
+    if((ip = iget(ROOTDEV, ROOTINO)) == 0)
+      return 0;
+  } else if(dp)
+    ip = idup(dp);
   else
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    if(namecmp(name, "..") == 0)
+      ip = mountpoint(ip);  // look up ".." in the mount point's directory
+    if(!(nameiparent && *path == '\0') && (next = dcachelookup(ip, name)) != 0){
+      // Hit: no need to lock or read the directory.
+      iput(ip);
+      if((ip = mountroot(next)) == 0)
+        return 0;
+      continue;
+    }
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
-    iunlockput(ip);
-    ip = next;
+    dcacheadd(ip, name, next->inum);
+    iunlockshared(ip);
+    iput(ip);
+    if((ip = mountroot(next)) == 0)
+      return 0;
   }
   if(nameiparent){
     iput(ip);
@@ -664,11 +1596,25 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, name);
+}
+
+// namei() and nameiparent() for paths relative to directory dp.
+struct inode*
+nameiat(struct inode *dp, char *path)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, name);
+}
+
+struct inode*
+nameiparentat(struct inode *dp, char *path, char *name)
+{
+  return namex(dp, path, 1, name);
 }
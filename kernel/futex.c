@@ -0,0 +1,85 @@
+//
+// Futexes: the kernel half of user-space locks.
+//
+// A user lock is an int in user memory that threads change with
+// atomic instructions, and enter the kernel only to sleep when
+// the lock is busy, or to wake sleepers when they release it:
+//
+//   futex(uaddr, FUTEX_WAIT, val): sleep if *uaddr is still val.
+//   futex(uaddr, FUTEX_WAKE, n): wake up to n sleepers on uaddr.
+//
+// A futex is known by the physical address of its int, which
+// is the same in every page table that maps it, and sleepers
+// sleep on that address with sleep(), so they are found in the
+// hashed wait queues like any other sleeper. The check of *uaddr
+// and the sleep are made atomic with respect to FUTEX_WAKE by
+// one of a few spinlocks, chosen by hashing the address.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "futex.h"
+
+#define NFUTEXLOCK 13
+#define FHASH(pa) (((pa) >> 2) % NFUTEXLOCK)
+
+static struct spinlock futexlock[NFUTEXLOCK];
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXLOCK; i++)
+    initlock(&futexlock[i], "futex");
+}
+
+// The physical address of the int at user address uaddr,
+// or 0 if it is not mapped or not aligned.
+static uint64
+futexkey(uint64 uaddr)
+{
+  uint64 pa;
+
+  if(uaddr % sizeof(int) != 0)
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(uaddr))) == 0)
+    return 0;
+  return pa + (uaddr - PGROUNDDOWN(uaddr));
+}
+
+int
+futex(uint64 uaddr, int op, int val)
+{
+  struct spinlock *lk;
+  uint64 pa;
+  int n;
+
+  if((pa = futexkey(uaddr)) == 0)
+    return -1;
+  lk = &futexlock[FHASH(pa)];
+
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(lk);
+    if(__atomic_load_n((int*)pa, __ATOMIC_SEQ_CST) != val){
+      release(lk);
+      return -1;
+    }
+    sleep((void*)pa, lk);
+    release(lk);
+    return 0;
+  case FUTEX_WAKE:
+    if(val <= 0)
+      return 0;
+    acquire(lk);
+    n = wakeupn((void*)pa, val);
+    release(lk);
+    return n;
+  }
+  return -1;
+}
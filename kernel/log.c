@@ -29,6 +29,12 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// Each disk with a file system has its own on-disk log. A
+// transaction can contain blocks of several disks; commit()
+// writes and installs each disk's part in turn. Every FS system
+// call only changes one file system, so each call's updates are
+// still atomic.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -37,42 +43,57 @@ struct logheader {
   int block[LOGSIZE];
 };
 
-struct log {
-  struct spinlock lock;
+// One disk's log.
+struct logdisk {
+  int active;      // initlog() has recovered it
   int start;
   int size;
-  int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
   int dev;
+  uint64 freed;    // bitmap blocks (b/BPB mod 64) with a block freed in this transaction
   struct logheader lh;
 };
+
+struct log {
+  struct spinlock lock;
+  int outstanding; // how many FS sys calls are executing.
+  int committing;  // in commit(), please wait.
+  struct logdisk disk[NDISK];
+};
 struct log log;
 
-static void recover_from_log(void);
+static void recover_from_log(struct logdisk*);
 static void commit();
 
 void
 initlog(int dev, struct superblock *sb)
 {
+  struct logdisk *ld = &log.disk[dev - ROOTDEV];
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
-  initlock(&log.lock, "log");
-  log.start = sb->logstart;
-  log.size = sb->nlog;
-  log.dev = dev;
-  recover_from_log();
+  if(dev == ROOTDEV)
+    initlock(&log.lock, "log");
+  ld->start = sb->logstart;
+  ld->size = sb->nlog;
+  ld->dev = dev;
+  // nothing can be logged to dev until active is set, so
+  // commit() won't touch ld while recovery is going on.
+  recover_from_log(ld);
+  acquire(&log.lock);
+  ld->active = 1;
+  release(&log.lock);
 }
 
 // Copy committed blocks from log to their home location
 static void
-install_trans(int recovering)
+install_trans(struct logdisk *ld, int recovering)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
+  for (tail = 0; tail < ld->lh.n; tail++) {
+    struct buf *lbuf = bread(ld->dev, ld->start+tail+1); // read log block
+    struct buf *dbuf = bread(ld->dev, ld->lh.block[tail]); // read dst
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
     if(recovering == 0)
@@ -84,14 +105,14 @@ install_trans(int recovering)
 
 // Read the log header from disk into the in-memory log header
 static void
-read_head(void)
+read_head(struct logdisk *ld)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(ld->dev, ld->start);
   struct logheader *lh = (struct logheader *) (buf->data);
   int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
+  ld->lh.n = lh->n;
+  for (i = 0; i < ld->lh.n; i++) {
+    ld->lh.block[i] = lh->block[i];
   }
   brelse(buf);
 }
@@ -100,26 +121,40 @@ read_head(void)
 // This is the true point at which the
 // current transaction commits.
 static void
-write_head(void)
+write_head(struct logdisk *ld)
 {
-  struct buf *buf = bread(log.dev, log.start);
+  struct buf *buf = bread(ld->dev, ld->start);
   struct logheader *hb = (struct logheader *) (buf->data);
   int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
+  hb->n = ld->lh.n;
+  for (i = 0; i < ld->lh.n; i++) {
+    hb->block[i] = ld->lh.block[i];
   }
   bwrite(buf);
   brelse(buf);
 }
 
 static void
-recover_from_log(void)
+recover_from_log(struct logdisk *ld)
+{
+  read_head(ld);
+  install_trans(ld, 1); // if committed, copy from log to disk
+  ld->lh.n = 0;
+  write_head(ld); // clear the log
+}
+
+// The most log space used on any disk so far in this
+// transaction. Caller must hold log.lock.
+static int
+log_used(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  int i, n = 0;
+
+  for(i = 0; i < NDISK; i++){
+    if(log.disk[i].active && log.disk[i].lh.n > n)
+      n = log.disk[i].lh.n;
+  }
+  return n;
 }
 
 // called at the start of each FS system call.
@@ -130,7 +165,7 @@ begin_op(void)
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log_used() + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
@@ -176,13 +211,13 @@ end_op(void)
 
 // Copy modified blocks from cache to log.
 static void
-write_log(void)
+write_log(struct logdisk *ld)
 {
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
+  for (tail = 0; tail < ld->lh.n; tail++) {
+    struct buf *to = bread(ld->dev, ld->start+tail+1); // log block
+    struct buf *from = bread(ld->dev, ld->lh.block[tail]); // cache block
     memmove(to->data, from->data, BSIZE);
     bwrite(to);  // write the log
     brelse(from);
@@ -193,12 +228,17 @@ write_log(void)
 static void
 commit()
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  struct logdisk *ld;
+
+  for (ld = log.disk; ld < &log.disk[NDISK]; ld++) {
+    if (ld->active && ld->lh.n > 0) {
+      write_log(ld);     // Write modified blocks from cache to log
+      write_head(ld);    // Write header to disk -- the real commit
+      install_trans(ld, 0); // Now install writes to home locations
+      ld->lh.n = 0;
+      write_head(ld);    // Erase the transaction from the log
+      ld->freed = 0;     // those frees are on disk now
+    }
   }
 }
 
@@ -214,23 +254,53 @@ commit()
 void
 log_write(struct buf *b)
 {
+  struct logdisk *ld;
   int i;
 
+  if(b->dev < ROOTDEV || b->dev >= ROOTDEV + NDISK)
+    panic("log_write: dev");
+  ld = &log.disk[b->dev - ROOTDEV];
+
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (!ld->active)
+    panic("log_write: no log");
+  if (ld->lh.n >= LOGSIZE || ld->lh.n >= ld->size - 1)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
 
-  for (i = 0; i < log.lh.n; i++) {
-    if (log.lh.block[i] == b->blockno)   // log absorption
+  for (i = 0; i < ld->lh.n; i++) {
+    if (ld->lh.block[i] == b->blockno)   // log absorption
       break;
   }
-  log.lh.block[i] = b->blockno;
-  if (i == log.lh.n) {  // Add new block to log?
+  ld->lh.block[i] = b->blockno;
+  if (i == ld->lh.n) {  // Add new block to log?
     bpin(b);
-    log.lh.n++;
+    ld->lh.n++;
   }
   release(&log.lock);
 }
 
+
+// bfree() has freed block b of dev in the current transaction.
+void
+log_bfree(int dev, uint b)
+{
+  acquire(&log.lock);
+  log.disk[dev - ROOTDEV].freed |= 1UL << ((b / BPB) % 64);
+  release(&log.lock);
+}
+
+// Whether block b of dev may have been freed in the current
+// transaction. Until that commits, a crash would give the block
+// back to its old owner, so it must not be written outside the log.
+int
+log_bfreed(int dev, uint b)
+{
+  int r;
+
+  acquire(&log.lock);
+  r = (log.disk[dev - ROOTDEV].freed >> ((b / BPB) % 64)) & 1;
+  release(&log.lock);
+  return r;
+}
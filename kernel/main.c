@@ -20,12 +20,14 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
-    trapinit();      // trap vectors
+    futexinit();     // futex locks
+    timerqinit();    // per-hart timer queues
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    tmpinit();       // tmpfs
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
@@ -21,14 +21,18 @@
 #define UART0 0x10000000L
 #define UART0_IRQ 10
 
-// virtio mmio interface
+// virtio mmio interface; qemu puts device i at VIRTIO0 + i*0x1000.
 #define VIRTIO0 0x10001000
 #define VIRTIO0_IRQ 1
+#define VIRTIO1 0x10002000
+#define VIRTIO1_IRQ 2
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // machine software interrupt
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define TIMEBASE 10000000L           // CLINT_MTIME cycles per second, in qemu.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -62,6 +66,12 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   trapframes of the process's other threads, from clone()
+//   VDSO (struct vdso, shared by all processes, read-only)
+//   USYSCALL (struct usyscall, the process's own, read-only)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define VDSO (USYSCALL - PGSIZE)
+#define THREADFRAME(i) (VDSO - (i)*PGSIZE)  // 0 < i < NPROC
@@ -1,13 +1,21 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define TICK    1000000  // timer cycles per scheduling tick; 1/10th second in qemu
+#define NPRIO         4  // scheduling priority levels
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // cached i-nodes to keep before recycling
+#define NDENTRY     128  // cached directory entries for path lookup
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
+#define NDISK         2  // virtio disks, devices ROOTDEV..ROOTDEV+NDISK-1
+#define TMPDEV        3  // device number of the in-memory tmpfs
+#define NMOUNT        4  // maximum number of mounted file systems
+#define NTMPINODE   200  // number of inodes in the tmpfs
 #define MAXARG       32  // max exec arguments
+#define MAXIOV       16  // max buffers per readv/writev
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       1000  // default size of file system in blocks
 #define MAXPATH      128   // maximum file path name
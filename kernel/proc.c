@@ -5,20 +5,105 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "vdso.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
-
 struct proc *initproc;
 
+// Each struct proc has a page of its own from kalloc(), from
+// allocproc() until freeproc(). A process is found by pid in
+// a hash table, by its parent on a list of children, and by
+// its leader, if it is a thread, on a list of threads, so that
+// nothing has to look at every process.
+//
+// Kernel stacks live in NPROC slots beneath the trampoline, at
+// KSTACK(i), each above an invalid guard page. A process's stack
+// is mapped into a free slot when the process is made and
+// unmapped when it is freed, so a slot's mapping may change
+// behind the back of a hart that has it in its TLB. Before a
+// hart runs a process it flushes its TLB if any slot has
+// changed since it last did; see scheduler(). (It flushes on
+// every trap from user space anyway, so this costs little.)
+#define NPIDHASH 1024
+#define PIDHASH(pid) ((pid) % NPIDHASH)
+
 int nextpid = 1;
+static struct proc *pidhash[NPIDHASH];
+static int kslot[NPROC];  // free kernel stack slots, a stack
+static int nkslot;
+static uint kstackgen;    // changes to the slots so far
+
+// protects nextpid, pidhash, and the kernel stack slots.
+// must be acquired before any p->lock.
 struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
+extern pagetable_t kernel_pagetable; // vm.c
+
+// The vDSO page, mapped read-only into every process at VDSO.
+// The scheduler keeps its per-hart state up to date.
+static struct vdso *vdso;
+
+// Per-hart run queues. Every RUNNABLE process is on exactly
+// one of them, linked through p->rqnext, from the moment it
+// becomes RUNNABLE until a scheduler takes it off to run it.
+// A hart runs its own queue and, when that is empty, steals
+// from the longest other queue. A process joins the queue of
+// the hart it last ran on, or, new from fork(), its parent's,
+// so that it finds that hart's caches and TLB warm.
+//
+// p->affinity is the set of harts p may run on. A process that
+// is not allowed on the hart it last ran on joins the least
+// loaded allowed hart instead, and a hart steals only processes
+// that are allowed on it. A scheduler that takes a process off
+// its own queue that may no longer run there (its affinity was
+// changed while it waited) moves it on.
+// p->lock is acquired before a queue's lock, and the scheduler
+// releases the queue lock before it acquires p->lock.
+//
+// Scheduling is a multi-level feedback queue. Each run queue
+// has a FIFO list per priority level, and a hart runs the
+// highest level that has a process. A process at level l runs
+// for up to SLICE(l) ticks; if it uses them all it moves down a
+// level, so CPU-bound processes sink while those that sleep
+// often stay high. It is preempted early if a process of a
+// higher level waits on its hart. Every BOOSTTICKS ticks all
+// processes return to their nice level, so none starves; this
+// is done lazily, by boost() for a process when it next runs or
+// queues, and by runqboost() for those waiting on a run queue
+// when a hart next takes from it.
+#define SLICE(level) (1 << (level))
+#define BOOSTTICKS 50
+#define ALLCPUS ((1UL << NCPU) - 1)
+
+static uint64 online;  // harts that have entered scheduler()
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  int n;               // length; read without the lock as a hint
+  uint boost;          // boost period it was last boosted in
+} runq[NCPU];
+
+// Wait queues for sleep() and wakeup(), hashed by channel, so
+// that wakeup() only looks at processes that sleep on channels
+// in the same bucket. A sleeping process is on the list of its
+// channel's bucket, linked through p->wqnext and p->wqprev,
+// until it takes itself off after waking. A bucket's lock is
+// acquired after the sleeper's condition lock and before any
+// p->lock.
+#define NWAITQ 61
+#define WHASH(chan) ((((uint64)(chan)) >> 3) % NWAITQ)
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
@@ -26,34 +111,42 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
+// Make the page-table pages for the kernel stack slots, so that
+// a stack can be mapped into any slot without allocating.
 void
 proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
+  int i;
   
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  for(i = 0; i < NPROC; i++) {
+    if(walk(kpgtbl, KSTACK(i), 1) == 0)
+      panic("proc_mapstacks");
   }
 }
 
-// initialize the proc table at boot time.
+// initialize the process tables at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
+  struct runq *rq;
+  struct waitq *wq;
+  int i;
   
+  if(sizeof(struct proc) > PGSIZE)
+    panic("procinit: struct proc");
+  if((vdso = (struct vdso*)kalloc()) == 0)
+    panic("procinit: vdso");
+  memset(vdso, 0, PGSIZE);
+  vdso->timebase = TIMEBASE;
+  vdso->tick = TICK;
+
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  for(rq = runq; rq < &runq[NCPU]; rq++)
+    initlock(&rq->lock, "runq");
+  for(wq = waitq; wq < &waitq[NWAITQ]; wq++)
+    initlock(&wq->lock, "waitq");
+  for(i = NPROC-1; i >= 0; i--)
+    kslot[nkslot++] = i;
 }
 
 // Must be called with interrupts disabled,
@@ -85,53 +178,363 @@ myproc(void) {
   return p;
 }
 
-int
-allocpid() {
-  int pid;
-  
+// Give p a new pid, and enter it in the pid hash table.
+static void
+allocpid(struct proc *p)
+{
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  p->hashnext = pidhash[PIDHASH(p->pid)];
+  pidhash[PIDHASH(p->pid)] = p;
   release(&pid_lock);
-
-  return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Find the process with the given pid, and return it with
+// p->lock held, or return 0 if there is none.
 static struct proc*
-allocproc(void)
+findproc(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[PIDHASH(pid)]; p; p = p->hashnext){
+    if(p->pid == pid)
+      break;
+  }
+  // p cannot be freed while we hold pid_lock: freeproc() must
+  // acquire it to take p out of the table, after it has made p
+  // UNUSED and let go of p->lock. Once we hold the lock of a p
+  // that is not UNUSED, freeproc() cannot start on it, so
+  // pid_lock may go.
+  if(p){
     acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
+    if(p->state == UNUSED){
       release(&p->lock);
+      p = 0;
     }
   }
+  release(&pid_lock);
+  return p;
+}
+
+// Map a new kernel stack for p into a free slot.
+// Returns -1 if there is none or memory runs out.
+static int
+kstackalloc(struct proc *p)
+{
+  char *pa;
+  int i;
+
+  if((pa = kalloc()) == 0)
+    return -1;
+  acquire(&pid_lock);
+  if(nkslot == 0){
+    release(&pid_lock);
+    kfree(pa);
+    return -1;
+  }
+  i = kslot[--nkslot];
+  if(mappages(kernel_pagetable, KSTACK(i), PGSIZE, (uint64)pa, PTE_R | PTE_W) != 0)
+    panic("kstackalloc");
+  kstackgen++;
+  release(&pid_lock);
+  p->kstack = KSTACK(i);
   return 0;
+}
+
+// Unmap and free p's kernel stack, and give back its slot.
+static void
+kstackfree(struct proc *p)
+{
+  acquire(&pid_lock);
+  uvmunmap(kernel_pagetable, p->kstack, 1, 1);
+  kslot[nkslot++] = (TRAMPOLINE - p->kstack) / (2*PGSIZE) - 1;
+  kstackgen++;
+  release(&pid_lock);
+  p->kstack = 0;
+}
+
+// Return p to its nice level if a boost period has passed
+// since its level was last reset. Caller must hold p->lock.
+static void
+boost(struct proc *p)
+{
+  uint period = uptime() / BOOSTTICKS;
+
+  if(p->boost != period){
+    p->boost = period;
+    p->level = p->nice;
+    p->used = 0;
+  }
+}
+
+// Work allowed on the harts in mask has been queued for hart
+// id: wake it if it is idle. If it is busy and the work will
+// have to wait (wait is set), wake some other idle hart of
+// mask instead, to steal the work.
+static void
+kick(int id, int wait, uint64 mask)
+{
+  int i;
+
+  // pairs with the barrier in idle(): either the idle hart
+  // sees the queued work, or we see that it is idle.
+  __sync_synchronize();
+  if(cpus[id].idle){
+    sendipi(id);
+    return;
+  }
+  if(!wait)
+    return;
+  for(i = 0; i < NCPU; i++){
+    if((mask & (1UL << i)) && cpus[i].idle){
+      sendipi(i);
+      return;
+    }
+  }
+}
+
+// The online hart of mask with the shortest run queue.
+static int
+pickcpu(uint64 mask)
+{
+  int i, id = -1;
+
+  mask &= online;
+  for(i = 0; i < NCPU; i++){
+    if((mask & (1UL << i)) && (id < 0 || runq[i].n < runq[id].n))
+      id = i;
+  }
+  if(id < 0)
+    panic("pickcpu");
+  return id;
+}
+
+// Make p RUNNABLE and add it to the tail of its level's list
+// on the run queue of p->cpu, or of another hart if p may not
+// run on that one. Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  struct runq *rq;
+  int l;
+
+  if((p->affinity & (1UL << p->cpu)) == 0)
+    p->cpu = pickcpu(p->affinity);
+  rq = &runq[p->cpu];
+  p->state = RUNNABLE;
+  boost(p);
+  l = p->level;
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail[l])
+    rq->tail[l]->rqnext = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+  rq->n++;
+  vdso->cpu[p->cpu].nrun = rq->n;
+  release(&rq->lock);
+  kick(p->cpu, rq->n > 1 || p->cpu != cpuid(), p->affinity);
+}
+
+// Move every process waiting on rq below its nice level to the
+// tail of its nice level's list, at the start of each boost
+// period. boost() resets its level when it runs. p->nice is
+// read without p->lock; at worst a process set to a new nice
+// level meanwhile waits in the wrong list until the next period.
+// Caller must hold rq->lock.
+static void
+runqboost(struct runq *rq)
+{
+  struct proc *p, *next;
+  int l, nice;
+
+  // going up the levels, a process only moves to a level whose
+  // list has already been rebuilt.
+  for(l = 1; l < NPRIO; l++){
+    p = rq->head[l];
+    rq->head[l] = rq->tail[l] = 0;
+    for(; p; p = next){
+      next = p->rqnext;
+      nice = p->nice < l ? p->nice : l;
+      p->rqnext = 0;
+      if(rq->tail[nice])
+        rq->tail[nice]->rqnext = p;
+      else
+        rq->head[nice] = p;
+      rq->tail[nice] = p;
+    }
+  }
+}
+
+// Take the first process of the highest level on run queue rq,
+// or return 0 if there is none. A thief (not -1) is stealing
+// for another hart, and takes only a process allowed there.
+// p->affinity is read without p->lock; the scheduler checks it
+// again once it holds the lock.
+static struct proc*
+runqget(struct runq *rq, int thief)
+{
+  struct proc *p = 0, *prev;
+  uint period = uptime() / BOOSTTICKS;
+  int l;
+
+  if(rq->n == 0)
+    return 0;  // don't touch the lock of an empty queue.
+  acquire(&rq->lock);
+  if(rq->boost != period){
+    rq->boost = period;
+    runqboost(rq);
+  }
+  for(l = 0; l < NPRIO; l++){
+    prev = 0;
+    for(p = rq->head[l]; p; prev = p, p = p->rqnext){
+      if(thief < 0 || (p->affinity & (1UL << thief)))
+        break;
+    }
+    if(p){
+      if(prev)
+        prev->rqnext = p->rqnext;
+      else
+        rq->head[l] = p->rqnext;
+      if(rq->tail[l] == p)
+        rq->tail[l] = prev;
+      rq->n--;
+      vdso->cpu[rq - runq].nrun = rq->n;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Is there a process on a run queue that hart id could run?
+static int
+runqbusy(int id)
+{
+  struct proc *p;
+  int i, l, busy;
 
-found:
-  p->pid = allocpid();
+  for(i = 0; i < NCPU; i++){
+    if(runq[i].n == 0)
+      continue;
+    if(i == id)
+      return 1;
+    busy = 0;
+    acquire(&runq[i].lock);
+    for(l = 0; l < NPRIO && !busy; l++){
+      for(p = runq[i].head[l]; p && !busy; p = p->rqnext)
+        busy = (p->affinity & (1UL << id)) != 0;
+    }
+    release(&runq[i].lock);
+    if(busy)
+      return 1;
+  }
+  return 0;
+}
+
+// Wait in wfi() until there may be work for this hart.
+// setrunnable() sends an idle hart an IPI when it queues work.
+// Idle harts stop their scheduling ticks meanwhile, and take
+// timer interrupts only for the deadlines of sleepers, so
+// that an idle machine takes no interrupts at all.
+static void
+idle(struct cpu *c, int id)
+{
+  intr_off();
+  c->idle = 1;
+  __sync_synchronize();
+  if(!runqbusy(id)){
+    vdso->cpu[id].idle = 1;
+    timerstop();
+    wfi();
+    timerstart();
+    vdso->cpu[id].idle = 0;
+  }
+  c->idle = 0;
+}
+
+// Find a process for hart id to run: the next one on its own
+// queue or, failing that, one stolen from the longest other
+// queue that has one allowed on hart id. Returns 0 if nothing
+// is RUNNABLE here.
+static struct proc*
+runqnext(int id)
+{
+  struct proc *p;
+  int i, victim, n;
+  uint64 tried = 1UL << id;
+
+  if((p = runqget(&runq[id], -1)) != 0)
+    return p;
+  for(;;){
+    victim = -1;
+    n = 0;
+    for(i = 0; i < NCPU; i++){
+      if((tried & (1UL << i)) == 0 && runq[i].n > n){
+        victim = i;
+        n = runq[i].n;
+      }
+    }
+    if(victim < 0)
+      return 0;
+    if((p = runqget(&runq[victim], id)) != 0)
+      return p;
+    tried |= 1UL << victim;
+  }
+}
+
+// Allocate a proc, with a kernel stack, and give it a pid.
+// Initialize state required to run in the kernel,
+// and return with p->lock held.
+// If a memory allocation fails, or there are NPROC
+// processes already, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = (struct proc*)kalloc()) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  initlock(&p->tlock, "thread");
+  if(kstackalloc(p) < 0){
+    kfree((void*)p);
+    return 0;
+  }
+
+  // findproc() may see p from now on, but not use it while it
+  // is UNUSED.
+  allocpid(p);
+  acquire(&p->lock);
   p->state = USED;
+  p->leader = p;
+  p->ofile = p->ofiles;
+  p->tfva = TRAPFRAME;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
+  // And a page for what user code may read of it directly.
+  if((p->usyscall = (struct usyscall *)kalloc()) == 0){
+    freeproc(p);
+    return 0;
+  }
+  memset(p->usyscall, 0, PGSIZE);
+  p->usyscall->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
@@ -145,25 +548,68 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages, unless p is a thread, whose pages
+// are its leader's.
+// p->lock must be held, and wait_lock too if p has a parent.
+// Releases p->lock.
 static void
 freeproc(struct proc *p)
 {
+  struct proc *lp = p->leader, **pp;
+
+  if(lp != p){
+    // a thread: give back its slot in the leader's page table.
+    acquire(&lp->tlock);
+    uvmunmap(p->pagetable, p->tfva, 1, 0);
+    for(pp = &lp->threads; *pp != p; pp = &(*pp)->tnext)
+      ;
+    *pp = p->tnext;
+    p->leader = 0;
+    release(&lp->tlock);
+  } else if(p->pagetable)
+    proc_freepagetable(p->pagetable, p->sz);
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
   p->pagetable = 0;
-  p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
+  if(p->parent){
+    if(p->sibprev)
+      p->sibprev->sibnext = p->sibnext;
+    else
+      p->parent->children = p->sibnext;
+    if(p->sibnext)
+      p->sibnext->sibprev = p->sibprev;
+    p->parent = 0;
+  }
   p->state = UNUSED;
+  release(&p->lock);
+
+  // no one else can find p now, except findproc(), which
+  // holds pid_lock while it looks.
+  acquire(&pid_lock);
+  for(pp = &pidhash[PIDHASH(p->pid)]; *pp != p; pp = &(*pp)->hashnext)
+    ;
+  *pp = p->hashnext;
+  release(&pid_lock);
+  if(p->kstack)
+    kstackfree(p);
+  kfree((void*)p);
+}
+
+// Make p a child of parent.
+// Caller must hold wait_lock.
+static void
+adopt(struct proc *parent, struct proc *p)
+{
+  p->parent = parent;
+  p->sibprev = 0;
+  p->sibnext = parent->children;
+  if(parent->children)
+    parent->children->sibprev = p;
+  parent->children = p;
 }
 
 // Create a user page table for a given process,
@@ -196,6 +642,23 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // map the process's usyscall page and the vDSO page below
+  // that, read-only, for user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, VDSO, PGSIZE, (uint64)vdso, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, USYSCALL, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -206,6 +669,8 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -241,29 +706,43 @@ userinit(void)
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
+  p->affinity = ALLCPUS;
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
+// A process with threads may not shrink: its other threads may
+// be running on other harts, whose TLBs could still map the
+// freed pages.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
   uint sz;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *lp = p->leader, *pp;
 
-  sz = p->sz;
+  acquire(&lp->tlock);
+  sz = *oldsz = p->sz;
   if(n > 0){
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+      release(&lp->tlock);
       return -1;
     }
   } else if(n < 0){
+    if(threaded(p)){
+      release(&lp->tlock);
+      return -1;
+    }
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  // every thread of the process sees the new size.
+  lp->sz = sz;
+  for(pp = lp->threads; pp; pp = pp->tnext)
+    pp->sz = sz;
+  release(&lp->tlock);
   return 0;
 }
 
@@ -281,13 +760,16 @@ fork(void)
     return -1;
   }
 
-  // Copy user memory from parent to child.
+  // Copy user memory from parent to child. The parent's other
+  // threads must not change it meanwhile.
+  acquire(&p->leader->tlock);
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    release(&p->leader->tlock);
     freeproc(np);
-    release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  release(&p->leader->tlock);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -295,6 +777,11 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
+  // the child starts afresh at its parent's nice level.
+  np->nice = np->level = p->nice;
+  np->boost = uptime() / BOOSTTICKS;
+  np->affinity = p->affinity;
+
   // increment reference counts on open file descriptors.
   for(i = 0; i < NOFILE; i++)
     if(p->ofile[i])
@@ -308,29 +795,155 @@ fork(void)
   release(&np->lock);
 
   acquire(&wait_lock);
-  np->parent = p;
+  adopt(p->leader, np);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = cpuid();
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Create a thread of the caller's process: a new process that
+// shares the caller's page table and open files, and starts in
+// user space at fn(arg) on the given stack. Its trapframe is
+// mapped in the shared page table at the first free slot
+// below TRAPFRAME. Returns the new thread's id (a pid).
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int i, tid;
+  struct proc *np;
+  struct proc *p = myproc(), *lp = p->leader;
+  pte_t *pte;
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  acquire(&lp->tlock);
+  for(i = 1; i < NPROC; i++){
+    pte = walk(p->pagetable, THREADFRAME(i), 0);
+    if(pte == 0 || (*pte & PTE_V) == 0)
+      break;
+  }
+  if(i == NPROC || mappages(p->pagetable, THREADFRAME(i), PGSIZE,
+                            (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&lp->tlock);
+    freeproc(np);
+    return -1;
+  }
+  proc_freepagetable(np->pagetable, 0);
+  kfree((void*)np->usyscall);
+  np->usyscall = 0;
+  np->pagetable = p->pagetable;
+  np->sz = p->sz;
+  np->ofile = lp->ofiles;
+  np->tfva = THREADFRAME(i);
+  np->leader = lp;
+  np->tnext = lp->threads;
+  lp->threads = np;
+  release(&lp->tlock);
+
+  // start at fn(arg), on the new stack.
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
+
+  np->nice = np->level = p->nice;
+  np->boost = uptime() / BOOSTTICKS;
+  np->affinity = p->affinity;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  tid = np->pid;
+
+  release(&np->lock);
+
+  // a leader that is exiting waits only for threads it can
+  // see, with their parent set; it sets killed first.
+  acquire(&wait_lock);
+  if(lp->killed){
+    release(&wait_lock);
+    acquire(&np->lock);
+    freeproc(np);
+    return -1;
+  }
+  adopt(lp, np);
+  release(&wait_lock);
+
+  np->cwd = idup(p->cwd);
+
+  acquire(&np->lock);
+  np->cpu = cpuid();
+  setrunnable(np);
+  release(&np->lock);
+
+  return tid;
+}
+
+// Does p's process have threads other than p?
+int
+threaded(struct proc *p)
+{
+  return p->leader != p || p->threads != 0;
+}
+
+// Kill the other threads of p, a leader, and wait for them all
+// to exit.
+static void
+killthreads(struct proc *p)
+{
+  struct proc *pp, *next;
+  int n;
+
+  acquire(&p->lock);
+  p->killed = 1;
+  release(&p->lock);
+
+  acquire(&wait_lock);
+  for(;;){
+    n = 0;
+    for(pp = p->children; pp; pp = next){
+      next = pp->sibnext;
+      if(pp->leader != p)
+        continue;
+      acquire(&pp->lock);
+      if(pp->state == ZOMBIE){
+        freeproc(pp);
+        continue;
+      }
+      n++;
+      pp->killed = 1;
+      if(pp->state == SLEEPING)
+        setrunnable(pp);
+      release(&pp->lock);
+    }
+    if(n == 0)
+      break;
+    sleep(p, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *next;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0)
+    return;
+  for(pp = p->children; pp; pp = next){
+    next = pp->sibnext;
+    adopt(initproc, pp);
   }
+  p->children = 0;
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -344,12 +957,17 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  // The process ends with its leader; a thread ends alone.
+  if(p->leader == p){
+    killthreads(p);
+
+    // Close all open files.
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        fileclose(f);
+        p->ofile[fd] = 0;
+      }
     }
   }
 
@@ -385,15 +1003,15 @@ wait(uint64 addr)
 {
   struct proc *np;
   int havekids, pid;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *lp = p->leader;
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through the children looking for exited ones.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
+    for(np = lp->children; np; np = np->sibnext){
+      if(np->leader == np){
         // make sure the child isn't still in exit() or swtch().
         acquire(&np->lock);
 
@@ -408,7 +1026,6 @@ wait(uint64 addr)
             return -1;
           }
           freeproc(np);
-          release(&np->lock);
           release(&wait_lock);
           return pid;
         }
@@ -423,7 +1040,51 @@ wait(uint64 addr)
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(lp, &wait_lock);  //DOC: wait-sleep
+  }
+}
+
+// Wait for the thread tid of this process, or for any thread
+// if tid is 0, to exit, and return its id. Return -1 if there
+// is no such thread, other than the caller.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *np;
+  int havethreads;
+  struct proc *p = myproc(), *lp = p->leader;
+
+  acquire(&wait_lock);
+
+  for(;;){
+    havethreads = 0;
+    for(np = lp->children; np; np = np->sibnext){
+      if(np->leader == lp && np != p && (tid == 0 || np->pid == tid)){
+        acquire(&np->lock);
+
+        havethreads = 1;
+        if(np->state == ZOMBIE){
+          tid = np->pid;
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                  sizeof(np->xstate)) < 0) {
+            release(&np->lock);
+            release(&wait_lock);
+            return -1;
+          }
+          freeproc(np);
+          release(&wait_lock);
+          return tid;
+        }
+        release(&np->lock);
+      }
+    }
+
+    if(!havethreads || p->killed){
+      release(&wait_lock);
+      return -1;
+    }
+
+    sleep(lp, &wait_lock);
   }
 }
 
@@ -439,28 +1100,56 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  uint gen;
   
   c->proc = 0;
+  __sync_fetch_and_or(&online, 1UL << id);
+  vdso->online = online;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
+    if((p = runqnext(id)) == 0){
+      idle(c, id);
+      continue;
+    }
+
+    // p is off the run queues, so no other hart can take it,
+    // but the hart that queued it may still be switching away
+    // from it, holding p->lock until it is done.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    if((p->affinity & (1UL << id)) == 0){
+      setrunnable(p);
       release(&p->lock);
+      continue;
     }
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    c->proc = p;
+    vdso->cpu[id].pid = p->pid;
+
+    // p's kernel stack may be in a slot whose mapping has
+    // changed since this hart last flushed its TLB. The queue
+    // locks order the mapping of p's own stack before this.
+    gen = kstackgen;
+    if(c->kstackgen != gen){
+      c->kstackgen = gen;
+      sfence_vma();
+    }
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    vdso->cpu[id].pid = 0;
+    release(&p->lock);
   }
 }
 
@@ -491,13 +1180,123 @@ sched(void)
   mycpu()->intena = intena;
 }
 
+// Charge the current process for a clock tick. Returns 1 if
+// it should give up the CPU: it has used its time slice, which
+// also moves it down a level, or a process of a higher level
+// is waiting on this hart's run queue.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int l, r = 0;
+
+  acquire(&p->lock);
+  boost(p);
+  if(++p->used >= SLICE(p->level)){
+    if(p->level < NPRIO-1)
+      p->level++;
+    p->used = 0;
+    r = 1;
+  } else {
+    // a racy look is fine: at worst we notice next tick.
+    rq = &runq[p->cpu];
+    for(l = 0; l < p->level; l++){
+      if(rq->head[l])
+        r = 1;
+    }
+  }
+  release(&p->lock);
+  return r;
+}
+
+// Set the nice level of the process with the given pid, or of
+// the caller if pid is 0, and move it to that level at once.
+// A RUNNABLE process keeps its place until it next runs.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < 0 || nice >= NPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->nice = p->level = nice;
+  p->used = 0;
+  release(&p->lock);
+  return 0;
+}
+
+// Return the nice level of the process with the given pid, or
+// of the caller if pid is 0.
+int
+getpriority(int pid)
+{
+  struct proc *p;
+  int nice;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  nice = p->nice;
+  release(&p->lock);
+  return nice;
+}
+
+// Set the harts that the process with the given pid, or the
+// caller if pid is 0, may run on. mask must include a hart that
+// is running. A process that is not allowed where it is moves
+// when it next queues to run; the caller moves at once.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  int move;
+
+  mask &= ALLCPUS;
+  if((mask & online) == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->affinity = mask;
+  move = p == myproc() && (mask & (1UL << cpuid())) == 0;
+  release(&p->lock);
+  if(move)
+    yield();
+  return 0;
+}
+
+// Return the running harts that the process with the given pid,
+// or the caller if pid is 0, may run on, or -1 if there is no
+// such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->affinity & online;
+  release(&p->lock);
+  return mask;
+}
+
 // Give up the CPU for one scheduling round.
 void
 yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -517,7 +1316,12 @@ forkret(void)
     // regular process (e.g., because it calls sleep), and thus cannot
     // be run from main().
     first = 0;
-    fsinit(ROOTDEV);
+#ifdef RAMDISK
+    if(ramdiskinit(ROOTDEV) < 0)
+      printf("ramdisk: not enough memory; using the disk\n");
+#endif
+    if(fsinit(ROOTDEV) < 0)
+      panic("fsinit");
   }
 
   usertrapret();
@@ -529,6 +1333,7 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = &waitq[WHASH(chan)];
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
@@ -536,10 +1341,20 @@ sleep(void *chan, struct spinlock *lk)
   // guaranteed that we won't miss any wakeup
   // (wakeup locks p->lock),
   // so it's okay to release lk.
+  // wakeup() looks for p on wq, so add p
+  // to it, under wq->lock, before that.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
+  p->wqprev = 0;
+  p->wqnext = wq->head;
+  if(wq->head)
+    wq->head->wqprev = p;
+  wq->head = p;
+  release(&wq->lock);
+
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
@@ -548,9 +1363,18 @@ sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  acquire(&wq->lock);
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  release(&wq->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -558,18 +1382,31 @@ sleep(void *chan, struct spinlock *lk)
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
+{
+  wakeupn(chan, NPROC);
+}
+
+// Wake up at most n processes sleeping on chan, and return
+// how many were woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
 {
   struct proc *p;
+  struct waitq *wq = &waitq[WHASH(chan)];
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+  acquire(&wq->lock);
+  for(p = wq->head; p && woken < n; p = p->wqnext){
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      setrunnable(p);
+      woken++;
     }
+    release(&p->lock);
   }
+  release(&wq->lock);
+  return woken;
 }
 
 // Kill the process with the given pid.
@@ -580,20 +1417,15 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -628,7 +1460,8 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// Takes only pid_lock, which keeps the procs from being freed;
+// no p->lock, to avoid wedging a stuck machine further.
 void
 procdump(void)
 {
@@ -641,16 +1474,21 @@ procdump(void)
   };
   struct proc *p;
   char *state;
+  int i;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
-    printf("\n");
+  acquire(&pid_lock);
+  for(i = 0; i < NPIDHASH; i++){
+    for(p = pidhash[i]; p; p = p->hashnext){
+      if(p->state == UNUSED)
+        continue;
+      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+        state = states[p->state];
+      else
+        state = "???";
+      printf("%d %s %s", p->pid, state, p->name);
+      printf("\n");
+    }
   }
+  release(&pid_lock);
 }
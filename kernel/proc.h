@@ -24,6 +24,8 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int idle;                   // In idle(), waiting for an IPI?
+  uint kstackgen;             // kstackgen when it last flushed its TLB
 };
 
 extern struct cpu cpus[NCPU];
@@ -92,17 +94,49 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int cpu;                     // Hart it last ran on, whose run queue it joins
+  int nice;                    // Priority set by setpriority(), 0 (high) to NPRIO-1
+  int level;                   // Current priority, nice to NPRIO-1
+  int used;                    // Ticks used at this level
+  uint boost;                  // Boost period when level was last reset
+  uint64 affinity;             // Harts it may run on, a bit for each
 
-  // wait_lock must be held when using this:
-  struct proc *parent;         // Parent process
+  // the run queue lock must be held when using this:
+  struct proc *rqnext;         // Next process on the run queue
 
-  // these are private to the process, so p->lock need not be held.
-  uint64 kstack;               // Virtual address of kernel stack
+  // the wait queue lock must be held when using these:
+  struct proc *wqnext;         // Wait queue links, while sleeping
+  struct proc *wqprev;
+
+  // pid_lock must be held when using this:
+  struct proc *hashnext;       // Next in its pid hash bucket
+
+  // wait_lock must be held when using these:
+  struct proc *parent;         // Parent process; a thread's is its leader
+  struct proc *children;       // First child, linked through sibnext and sibprev
+  struct proc *sibnext;        // Siblings, on the parent's list of children
+  struct proc *sibprev;
+
+  // Threads made by clone() share their leader's page table and
+  // open files. The leader is the first thread of the process,
+  // and outlives the others. The leader's tlock must be held to
+  // change the page table, the file table, sz, or a thread's
+  // leader, or the list of threads.
+  struct proc *leader;         // First thread of the process; p itself if p is
+  struct spinlock tlock;
+  struct proc *threads;        // The leader's other threads, linked through tnext
+  struct proc *tnext;
   uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  pagetable_t pagetable;       // User page table, the leader's
+  struct usyscall *usyscall;   // Page mapped read-only at USYSCALL, if p is a leader
+  struct file **ofile;         // Open files, the leader's ofiles
+  struct file *ofiles[NOFILE]; // The process's open files, if p is a leader
+
+  // these are private to the thread, so p->lock need not be held.
+  uint64 kstack;               // Virtual address of kernel stack
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // trapframe's user address, TRAPFRAME in a leader
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 };
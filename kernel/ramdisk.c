@@ -1,45 +1,126 @@
 //
-// ramdisk that uses the disk image loaded by qemu -initrd fs.img
+// ramdisk: serves a disk from memory, for runs that should not
+// be bound by disk I/O.
+//
+// ramdiskinit(dev) reads the whole of disk dev into pages from
+// kalloc() and then takes over dev's bdevsw entry. From then on
+// nothing goes to the real disk: writes stay in memory and are
+// lost at reboot.
+//
+// The buffer cache maps ramdisk blocks (bdevsw map) instead of
+// copying them, so bread() and bwrite() move no data; only the
+// O_DIRECT path (rw_direct) copies, to or from the caller's pages.
 //
 
 #include "types.h"
 #include "riscv.h"
 #include "defs.h"
 #include "param.h"
-#include "memlayout.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
-void
-ramdiskinit(void)
+#define BPP  (PGSIZE / BSIZE)           // blocks per page
+#define NPTR (PGSIZE / sizeof(char*))   // pointers per index page
+
+// the pages of a ramdisk, in a two-level index:
+// page pn is index[pn / NPTR][pn % NPTR].
+static struct ramdisk {
+  uint64 nblocks;
+  char ***index;
+} ramdisks[ROOTDEV+NDISK];
+
+// the memory holding block blockno.
+static char*
+ramblock(struct ramdisk *rd, uint blockno)
 {
+  uint pn = blockno / BPP;
+
+  if(blockno >= rd->nblocks)
+    panic("ramdisk: blockno too big");
+  return rd->index[pn / NPTR][pn % NPTR] + (blockno % BPP) * BSIZE;
 }
 
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-ramdiskrw(struct buf *b)
+static uint64
+ramdisknblocks(uint dev)
 {
-  if(!holdingsleep(&b->lock))
-    panic("ramdiskrw: buf not locked");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("ramdiskrw: nothing to do");
-
-  if(b->blockno >= FSSIZE)
-    panic("ramdiskrw: blockno too big");
-
-  uint64 diskaddr = b->blockno * BSIZE;
-  char *addr = (char *)RAMDISK + diskaddr;
-
-  if(b->flags & B_DIRTY){
-    // write
-    memmove(addr, b->data, BSIZE);
-    b->flags &= ~B_DIRTY;
-  } else {
-    // read
-    memmove(b->data, addr, BSIZE);
-    b->flags |= B_VALID;
+  return ramdisks[dev].nblocks;
+}
+
+static uchar*
+ramdiskmap(uint dev, uint blockno)
+{
+  return (uchar*)ramblock(&ramdisks[dev], blockno);
+}
+
+static void
+ramdiskrw_direct(uint dev, uint blockno, uint64 pa, uint len, int write)
+{
+  struct ramdisk *rd = &ramdisks[dev];
+  uint off;
+
+  for(off = 0; off < len; off += BSIZE, blockno++){
+    if(write)
+      memmove(ramblock(rd, blockno), (char*)pa + off, BSIZE);
+    else
+      memmove((char*)pa + off, ramblock(rd, blockno), BSIZE);
   }
 }
+
+static void
+ramdiskfree(struct ramdisk *rd)
+{
+  uint i, j;
+
+  for(i = 0; i < NPTR && rd->index[i]; i++){
+    for(j = 0; j < NPTR && rd->index[i][j]; j++)
+      kfree(rd->index[i][j]);
+    kfree(rd->index[i]);
+  }
+  kfree(rd->index);
+  rd->index = 0;
+}
+
+// Copy disk dev into memory and serve it from there.
+// Must be called before anything of dev is in the buffer
+// cache, in a process, since it reads the disk.
+// Returns -1, leaving dev alone, if memory runs out.
+int
+ramdiskinit(uint dev)
+{
+  struct ramdisk *rd = &ramdisks[dev];
+  uint64 n, pn, npages, len;
+  char *pg;
+
+  if((n = bnblocks(dev)) == 0)
+    return -1;
+  npages = (n + BPP - 1) / BPP;
+  if(npages > NPTR * NPTR || (rd->index = kalloc()) == 0)
+    return -1;
+  memset(rd->index, 0, PGSIZE);
+
+  for(pn = 0; pn < npages; pn++){
+    if(pn % NPTR == 0){
+      if((rd->index[pn / NPTR] = kalloc()) == 0)
+        goto bad;
+      memset(rd->index[pn / NPTR], 0, PGSIZE);
+    }
+    if((pg = kalloc()) == 0)
+      goto bad;
+    rd->index[pn / NPTR][pn % NPTR] = pg;
+    len = n - pn * BPP < BPP ? n - pn * BPP : BPP;
+    brw_direct(dev, pn * BPP, (uint64)pg, len * BSIZE, 0);
+  }
+
+  rd->nblocks = n;
+  bdevsw[dev] = (struct bdevsw){
+    ramdisknblocks, 0, ramdiskrw_direct, ramdiskmap
+  };
+  printf("ramdisk: dev %d, %d blocks in memory\n", dev, (int)n);
+  return 0;
+
+bad:
+  ramdiskfree(rd);
+  return -1;
+}
@@ -260,6 +260,14 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor-mode Counter-Enable
+#define COUNTEREN_TM (1L << 1) // the time CSR
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -276,6 +284,14 @@ intr_on()
   w_sstatus(r_sstatus() | SSTATUS_SIE);
 }
 
+// wait for an interrupt; returns at once if one is pending,
+// even with device interrupts disabled.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 // disable device interrupts
 static inline void
 intr_off()
@@ -1,6 +1,8 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  uint readers;      // Number of shared holders
+  uint wwait;        // Number of exclusive acquirers waiting
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
@@ -9,3 +9,12 @@ struct stat {
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
 };
+
+// A directory entry as returned by getdents(): the entry's
+// null-terminated name (DIRSIZ+1, rounded up) and, if asked
+// for, the metadata of the inode it names. Without it, only
+// dev and ino are filled in and type is 0.
+struct dirstat {
+  char name[16];
+  struct stat st;
+};
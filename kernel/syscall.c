@@ -104,6 +104,33 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_preadv(void);
+extern uint64 sys_pwritev(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_openat(void);
+extern uint64 sys_mkdirat(void);
+extern uint64 sys_mknodat(void);
+extern uint64 sys_unlinkat(void);
+extern uint64 sys_linkat(void);
+extern uint64 sys_fstatat(void);
+extern uint64 sys_mount(void);
+extern uint64 sys_umount(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getpriority(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +154,33 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_preadv]  sys_preadv,
+[SYS_pwritev] sys_pwritev,
+[SYS_lseek]   sys_lseek,
+[SYS_sendfile] sys_sendfile,
+[SYS_splice]  sys_splice,
+[SYS_getdents] sys_getdents,
+[SYS_openat]  sys_openat,
+[SYS_mkdirat] sys_mkdirat,
+[SYS_mknodat] sys_mknodat,
+[SYS_unlinkat] sys_unlinkat,
+[SYS_linkat]  sys_linkat,
+[SYS_fstatat] sys_fstatat,
+[SYS_mount]   sys_mount,
+[SYS_umount]  sys_umount,
+[SYS_setpriority] sys_setpriority,
+[SYS_getpriority] sys_getpriority,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clock_gettime] sys_clock_gettime,
 };
 
 void
@@ -20,3 +20,30 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_pread  22
+#define SYS_pwrite 23
+#define SYS_readv  24
+#define SYS_writev 25
+#define SYS_preadv 26
+#define SYS_pwritev 27
+#define SYS_lseek  28
+#define SYS_sendfile 29
+#define SYS_splice 30
+#define SYS_getdents 31
+#define SYS_openat 32
+#define SYS_mkdirat 33
+#define SYS_mknodat 34
+#define SYS_unlinkat 35
+#define SYS_linkat 36
+#define SYS_fstatat 37
+#define SYS_mount  38
+#define SYS_umount 39
+#define SYS_setpriority 40
+#define SYS_getpriority 41
+#define SYS_sched_setaffinity 42
+#define SYS_sched_getaffinity 43
+#define SYS_clone  44
+#define SYS_join   45
+#define SYS_futex  46
+#define SYS_nanosleep 47
+#define SYS_clock_gettime 48
@@ -15,54 +15,89 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// The file comes with a reference of its own, which the caller must
+// give back with fileclose(): another thread may close fd meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc();
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&p->leader->tlock);
+  if((f = p->ofile[fd]) != 0)
+    filedup(f);
+  release(&p->leader->tlock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
   if(pf)
     *pf = f;
+  else
+    fileclose(f);
   return 0;
 }
 
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
+// The file table is shared by the threads of a process.
 static int
 fdalloc(struct file *f)
 {
   int fd;
   struct proc *p = myproc();
 
+  acquire(&p->leader->tlock);
   for(fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd] == 0){
       p->ofile[fd] = f;
+      release(&p->leader->tlock);
       return fd;
     }
   }
+  release(&p->leader->tlock);
   return -1;
 }
 
+// Take f out of the file table at fd, if another thread has not
+// closed fd first, and return whether it was there.
+static int
+fdfree(int fd, struct file *f)
+{
+  struct proc *p = myproc();
+  int r = 0;
+
+  acquire(&p->leader->tlock);
+  if(p->ofile[fd] == f){
+    p->ofile[fd] = 0;
+    r = 1;
+  }
+  release(&p->leader->tlock);
+  return r;
+}
+
 uint64
 sys_dup(void)
 {
   struct file *f;
   int fd;
 
+  // the new fd takes over argfd()'s reference.
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -73,9 +108,11 @@ sys_read(void)
   int n;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  n = fileread(f, p, n);
+  fileclose(f);
+  return n;
 }
 
 uint64
@@ -85,10 +122,267 @@ sys_write(void)
   int n;
   uint64 p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argaddr(1, &p) < 0)
+  if(argint(2, &n) < 0 || argaddr(1, &p) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+
+  n = filewrite(f, p, n);
+  fileclose(f);
+  return n;
+}
+
+// Fetch the iovec array that is the nth system call argument,
+// with cnt elements, the (n+1)th argument, into iov. The
+// lengths, and their total, must fit in an int, since that
+// is what the byte count of the call is returned in.
+// Returns the element count, or -1.
+static int
+argiov(int n, struct iovec *iov)
+{
+  uint64 uiov, tot;
+  int cnt, i;
+
+  if(argaddr(n, &uiov) < 0 || argint(n+1, &cnt) < 0)
+    return -1;
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  tot = 0;
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len > 0x7fffffff)
+      return -1;
+    tot += iov[i].iov_len;
+    if(tot > 0x7fffffff)
+      return -1;
+  }
+  return cnt;
+}
+
+// Fetch the nth system call argument as the directory fd of an
+// *at() call, and return that directory's inode in *dp, which
+// path lookups will start from. AT_FDCWD gives 0, meaning the
+// current directory. namex() checks that *dp is a directory.
+// *pf is the directory's file, which keeps *dp alive; the caller
+// must give it back with fdput().
+static int
+argdirfd(int n, struct inode **dp, struct file **pf)
+{
+  int fd;
+  struct file *f;
+
+  if(argint(n, &fd) < 0)
+    return -1;
+  if(fd == AT_FDCWD){
+    *dp = 0;
+    *pf = 0;
+    return 0;
+  }
+  if(argfd(n, 0, &f) < 0)
+    return -1;
+  if(f->type != FD_INODE){
+    fileclose(f);
+    return -1;
+  }
+  *dp = f->ip;
+  *pf = f;
+  return 0;
+}
+
+// Give back the reference from argdirfd(), if any.
+static void
+fdput(struct file *f)
+{
+  if(f)
+    fileclose(f);
+}
+
+// Fetch the nth system call argument as a user pointer to a
+// file offset, which may be null, and the offset it points to.
+static int
+argoff(int n, uint64 *addr, int *off)
+{
+  if(argaddr(n, addr) < 0)
+    return -1;
+  if(*addr == 0)
+    return 0;
+  if(copyin(myproc()->pagetable, (char*)off, *addr, sizeof(*off)) < 0 || *off < 0)
+    return -1;
+  return 0;
+}
+
+// read and write at an explicit offset, leaving f->off alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  n = filereadv(f, 1, &iov, 1, off);
+  fileclose(f);
+  return n;
+}
+
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  uint64 p;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &off) < 0 || off < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  iov.iov_base = (void*)p;
+  iov.iov_len = n;
+  n = filewritev(f, 1, &iov, 1, off);
+  fileclose(f);
+  return n;
+}
+
+// scatter/gather forms of read and write.
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if((cnt = argiov(1, iov)) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  cnt = filereadv(f, 1, iov, cnt, -1);
+  fileclose(f);
+  return cnt;
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt;
+
+  if((cnt = argiov(1, iov)) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  cnt = filewritev(f, 1, iov, cnt, -1);
+  fileclose(f);
+  return cnt;
+}
+
+uint64
+sys_preadv(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt, off;
+
+  if((cnt = argiov(1, iov)) < 0 || argint(3, &off) < 0 || off < 0 ||
+     argfd(0, 0, &f) < 0)
+    return -1;
+  cnt = filereadv(f, 1, iov, cnt, off);
+  fileclose(f);
+  return cnt;
+}
+
+uint64
+sys_pwritev(void)
+{
+  struct file *f;
+  struct iovec iov[MAXIOV];
+  int cnt, off;
+
+  if((cnt = argiov(1, iov)) < 0 || argint(3, &off) < 0 || off < 0 ||
+     argfd(0, 0, &f) < 0)
+    return -1;
+  cnt = filewritev(f, 1, iov, cnt, off);
+  fileclose(f);
+  return cnt;
+}
+
+// Copy n bytes from infd to outfd inside the kernel. If off is
+// not null, read from *off and advance it instead of infd's offset.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  uint64 offp;
+  int off, n, r;
+
+  if(argoff(2, &offp, &off) < 0 || argint(3, &n) < 0 ||
+     argfd(0, 0, &out) < 0)
+    return -1;
+  if(argfd(1, 0, &in) < 0){
+    fileclose(out);
+    return -1;
+  }
+  r = filesplice(in, offp ? &off : 0, out, 0, n);
+  fileclose(in);
+  fileclose(out);
+  if(offp && copyout(myproc()->pagetable, offp, (char*)&off, sizeof(off)) < 0)
+    return -1;
+  return r;
+}
+
+// Move n bytes between any two files inside the kernel, at the
+// offsets inoff and outoff point to, or at the files' own
+// offsets when those are null.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  uint64 inoffp, outoffp;
+  int inoff, outoff, n, r;
+
+  if(argoff(1, &inoffp, &inoff) < 0 || argoff(3, &outoffp, &outoff) < 0 ||
+     argint(4, &n) < 0 || argfd(0, 0, &in) < 0)
+    return -1;
+  if(argfd(2, 0, &out) < 0){
+    fileclose(in);
+    return -1;
+  }
+  r = filesplice(in, inoffp ? &inoff : 0, out, outoffp ? &outoff : 0, n);
+  fileclose(in);
+  fileclose(out);
+  if(inoffp && copyout(myproc()->pagetable, inoffp, (char*)&inoff, sizeof(inoff)) < 0)
+    return -1;
+  if(outoffp && copyout(myproc()->pagetable, outoffp, (char*)&outoff, sizeof(outoff)) < 0)
+    return -1;
+  return r;
+}
+
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  uint64 p;
+  int n, withstat;
+
+  if(argaddr(1, &p) < 0 || argint(2, &n) < 0 ||
+     argint(3, &withstat) < 0 || argfd(0, 0, &f) < 0)
     return -1;
+  n = filegetdents(f, p, n, withstat);
+  fileclose(f);
+  return n;
+}
 
-  return filewrite(f, p, n);
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argint(1, &off) < 0 || argint(2, &whence) < 0 || argfd(0, 0, &f) < 0)
+    return -1;
+  off = fileseek(f, off, whence);
+  fileclose(f);
+  return off;
 }
 
 uint64
@@ -96,10 +390,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc();
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  // another thread may be closing fd too; only one may win.
+  acquire(&p->leader->tlock);
+  if((f = p->ofile[fd]) == 0){
+    release(&p->leader->tlock);
     return -1;
-  myproc()->ofile[fd] = 0;
+  }
+  p->ofile[fd] = 0;
+  release(&p->leader->tlock);
   fileclose(f);
   return 0;
 }
@@ -110,23 +412,26 @@ sys_fstat(void)
   struct file *f;
   uint64 st; // user pointer to struct stat
 
-  if(argfd(0, 0, &f) < 0 || argaddr(1, &st) < 0)
+  int r;
+
+  if(argaddr(1, &st) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
-uint64
-sys_link(void)
+// old and new are relative to olddp and newdp, or to the
+// current directory where those are 0.
+static int
+linkat(struct inode *olddp, char *old, struct inode *newdp, char *new)
 {
-  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
+  char name[DIRSIZ];
   struct inode *dp, *ip;
 
-  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
-    return -1;
-
   begin_op();
-  if((ip = namei(old)) == 0){
+  if((ip = nameiat(olddp, old)) == 0){
     end_op();
     return -1;
   }
@@ -142,7 +447,7 @@ sys_link(void)
   iupdate(ip);
   iunlock(ip);
 
-  if((dp = nameiparent(new, name)) == 0)
+  if((dp = nameiparentat(newdp, new, name)) == 0)
     goto bad;
   ilock(dp);
   if(dp->dev != ip->dev || dirlink(dp, name, ip->inum) < 0){
@@ -165,6 +470,37 @@ bad:
   return -1;
 }
 
+uint64
+sys_link(void)
+{
+  char new[MAXPATH], old[MAXPATH];
+
+  if(argstr(0, old, MAXPATH) < 0 || argstr(1, new, MAXPATH) < 0)
+    return -1;
+  return linkat(0, old, 0, new);
+}
+
+uint64
+sys_linkat(void)
+{
+  char new[MAXPATH], old[MAXPATH];
+  struct inode *olddp, *newdp;
+  struct file *oldf, *newf;
+  int r;
+
+  if(argstr(1, old, MAXPATH) < 0 || argstr(3, new, MAXPATH) < 0 ||
+     argdirfd(0, &olddp, &oldf) < 0)
+    return -1;
+  if(argdirfd(2, &newdp, &newf) < 0){
+    fdput(oldf);
+    return -1;
+  }
+  r = linkat(olddp, old, newdp, new);
+  fdput(oldf);
+  fdput(newf);
+  return r;
+}
+
 // Is the directory dp empty except for "." and ".." ?
 static int
 isdirempty(struct inode *dp)
@@ -181,19 +517,18 @@ isdirempty(struct inode *dp)
   return 1;
 }
 
-uint64
-sys_unlink(void)
+// Remove path, relative to directory start, or to the current
+// directory if start is 0.
+static int
+unlinkat(struct inode *start, char *path)
 {
   struct inode *ip, *dp;
   struct dirent de;
-  char name[DIRSIZ], path[MAXPATH];
+  char name[DIRSIZ];
   uint off;
 
-  if(argstr(0, path, MAXPATH) < 0)
-    return -1;
-
   begin_op();
-  if((dp = nameiparent(path, name)) == 0){
+  if((dp = nameiparentat(start, path, name)) == 0){
     end_op();
     return -1;
   }
@@ -210,7 +545,7 @@ sys_unlink(void)
 
   if(ip->nlink < 1)
     panic("unlink: nlink < 1");
-  if(ip->type == T_DIR && !isdirempty(ip)){
+  if(ip->type == T_DIR && (!isdirempty(ip) || ismountpoint(ip))){
     iunlockput(ip);
     goto bad;
   }
@@ -218,6 +553,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcacheforget(dp, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -238,19 +574,50 @@ bad:
   return -1;
 }
 
+uint64
+sys_unlink(void)
+{
+  char path[MAXPATH];
+
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return unlinkat(0, path);
+}
+
+uint64
+sys_unlinkat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  struct file *df;
+  int r;
+
+  if(argstr(1, path, MAXPATH) < 0 || argdirfd(0, &dp, &df) < 0)
+    return -1;
+  r = unlinkat(dp, path);
+  fdput(df);
+  return r;
+}
+
+// Create path, relative to directory start, or to the current
+// directory if start is 0.
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(struct inode *start, char *path, short type, short major, short minor)
 {
   struct inode *ip, *dp;
   char name[DIRSIZ];
+  uint inum;
 
-  if((dp = nameiparent(path, name)) == 0)
+  if((dp = nameiparentat(start, path, name)) == 0)
     return 0;
 
   ilock(dp);
 
-  if((ip = dirlookup(dp, name, 0)) != 0){
+  if((inum = dirfind(dp, name, 0)) != 0){
+    ip = iget(dp->dev, inum);
     iunlockput(dp);
+    if(ip == 0)
+      return 0;  // no memory for the inode
     ilock(ip);
     if(type == T_FILE && (ip->type == T_FILE || ip->type == T_DEVICE))
       return ip;
@@ -258,8 +625,10 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
-    panic("create: ialloc");
+  if((ip = ialloc(dp->dev, type)) == 0){
+    iunlockput(dp);  // tmpfs is full, or out of memory
+    return 0;
+  }
 
   ilock(ip);
   ip->major = major;
@@ -283,28 +652,25 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path, relative to directory dp, or to the current
+// directory if dp is 0. Returns the new file descriptor.
+static int
+openat(struct inode *dp, char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
   if(omode & O_CREATE){
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(dp, path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
       return -1;
     }
   } else {
-    if((ip = namei(path)) == 0){
+    if((ip = nameiat(dp, path)) == 0){
       end_op();
       return -1;
     }
@@ -340,6 +706,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->direct = (omode & O_DIRECT) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -352,13 +719,41 @@ sys_open(void)
 }
 
 uint64
-sys_mkdir(void)
+sys_open(void)
 {
   char path[MAXPATH];
+  int omode;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openat(0, path, omode);
+}
+
+uint64
+sys_openat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  struct file *df;
+  int omode, fd;
+
+  if(argstr(1, path, MAXPATH) < 0 || argint(2, &omode) < 0 ||
+     argdirfd(0, &dp, &df) < 0)
+    return -1;
+  fd = openat(dp, path, omode);
+  fdput(df);
+  return fd;
+}
+
+// Make a directory (type T_DIR) or device node (T_DEVICE) at
+// path, relative to directory dp, or the current directory if 0.
+static int
+mknodat(struct inode *dp, char *path, short type, short major, short minor)
+{
   struct inode *ip;
 
   begin_op();
-  if(argstr(0, path, MAXPATH) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if((ip = create(dp, path, type, major, minor)) == 0){
     end_op();
     return -1;
   }
@@ -367,23 +762,88 @@ sys_mkdir(void)
   return 0;
 }
 
+uint64
+sys_mkdir(void)
+{
+  char path[MAXPATH];
+
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+  return mknodat(0, path, T_DIR, 0, 0);
+}
+
+uint64
+sys_mkdirat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  struct file *df;
+  int r;
+
+  if(argstr(1, path, MAXPATH) < 0 || argdirfd(0, &dp, &df) < 0)
+    return -1;
+  r = mknodat(dp, path, T_DIR, 0, 0);
+  fdput(df);
+  return r;
+}
+
 uint64
 sys_mknod(void)
 {
-  struct inode *ip;
   char path[MAXPATH];
   int major, minor;
 
-  begin_op();
-  if((argstr(0, path, MAXPATH)) < 0 ||
+  if(argstr(0, path, MAXPATH) < 0 ||
      argint(1, &major) < 0 ||
-     argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEVICE, major, minor)) == 0){
+     argint(2, &minor) < 0)
+    return -1;
+  return mknodat(0, path, T_DEVICE, major, minor);
+}
+
+uint64
+sys_mknodat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp;
+  struct file *df;
+  int major, minor, r;
+
+  if(argstr(1, path, MAXPATH) < 0 || argint(2, &major) < 0 ||
+     argint(3, &minor) < 0 || argdirfd(0, &dp, &df) < 0)
+    return -1;
+  r = mknodat(dp, path, T_DEVICE, major, minor);
+  fdput(df);
+  return r;
+}
+
+// Like fstat(), for path relative to directory fd.
+uint64
+sys_fstatat(void)
+{
+  char path[MAXPATH];
+  struct inode *dp, *ip;
+  struct file *df;
+  struct stat st;
+  uint64 addr; // user pointer to struct stat
+
+  if(argstr(1, path, MAXPATH) < 0 || argaddr(2, &addr) < 0 ||
+     argdirfd(0, &dp, &df) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = nameiat(dp, path)) == 0){
     end_op();
+    fdput(df);
     return -1;
   }
+  ilock(ip);
+  stati(ip, &st);
   iunlockput(ip);
   end_op();
+  fdput(df);
+
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
   return 0;
 }
 
@@ -468,19 +928,70 @@ sys_pipe(void)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+    if(fd0 < 0 || fdfree(fd0, rf))
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    if(fdfree(fd0, rf))
+      fileclose(rf);
+    if(fdfree(fd1, wf))
+      fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+// Mount the file system on device dev (a second disk, or
+// TMPDEV for tmpfs) on the directory path.
+uint64
+sys_mount(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  int dev;
+
+  if(argint(0, &dev) < 0 || argstr(1, path, MAXPATH) < 0)
+    return -1;
+  if(dev != TMPDEV && (dev <= ROOTDEV || dev >= ROOTDEV + NDISK))
+    return -1;
+  if(dev != TMPDEV && fsinit(dev) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  if(mount(ip, dev) < 0){
+    iput(ip);
+    end_op();
+    return -1;
+  }
+  end_op();
+  return 0;
+}
+
+// Unmount the file system mounted on path.
+uint64
+sys_umount(void)
+{
+  char path[MAXPATH];
+  struct inode *ip;
+  int r;
+
+  if(argstr(0, path, MAXPATH) < 0)
+    return -1;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return -1;
+  }
+  r = umount(ip);
+  iput(ip);
+  end_op();
+  return r;
+}
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "time.h"
 
 uint64
 sys_exit(void)
@@ -17,10 +18,11 @@ sys_exit(void)
   return 0;  // not reached
 }
 
+// the pid of the process, which is that of its first thread.
 uint64
 sys_getpid(void)
 {
-  return myproc()->pid;
+  return myproc()->leader->pid;
 }
 
 uint64
@@ -29,6 +31,38 @@ sys_fork(void)
   return fork();
 }
 
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+  uint64 p;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return join(tid, p);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 uaddr;
+  int op, val;
+
+  if(argaddr(0, &uaddr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(uaddr, op, val);
+}
+
 uint64
 sys_wait(void)
 {
@@ -41,13 +75,12 @@ sys_wait(void)
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
@@ -56,21 +89,59 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return timersleep(timenow() + (uint64)n * TICK);
+}
+
+#define NSEC 1000000000L  // nanoseconds per second
+
+uint64
+sys_nanosleep(void)
+{
+  uint64 req, rem, when, now, left;
+  struct timespec ts;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &req) < 0 || argaddr(1, &rem) < 0)
+    return -1;
+  if(copyin(p->pagetable, (char*)&ts, req, sizeof(ts)) < 0)
+    return -1;
+  if(ts.tv_nsec >= NSEC || ts.tv_sec > 0xffffffff)
+    return -1;
+  // round up to whole cycles, so as never to wake early.
+  when = timenow() + ts.tv_sec * TIMEBASE +
+         (ts.tv_nsec * TIMEBASE + NSEC - 1) / NSEC;
+  if(timersleep(when) == 0)
+    return 0;
+  // killed: tell the caller how much was left.
+  now = timenow();
+  left = when > now ? when - now : 0;
+  ts.tv_sec = left / TIMEBASE;
+  ts.tv_nsec = (left % TIMEBASE) * NSEC / TIMEBASE;
+  if(rem != 0)
+    copyout(p->pagetable, rem, (char*)&ts, sizeof(ts));
+  return -1;
+}
+
+uint64
+sys_clock_gettime(void)
+{
+  int clock;
+  uint64 addr, now;
+  struct timespec ts;
+
+  if(argint(0, &clock) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  now = timenow();
+  ts.tv_sec = now / TIMEBASE;
+  ts.tv_nsec = (now % TIMEBASE) * NSEC / TIMEBASE;
+  return copyout(myproc()->pagetable, addr, (char*)&ts, sizeof(ts));
 }
 
 uint64
@@ -83,15 +154,49 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks have passed since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return uptime();
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, nice;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+uint64
+sys_getpriority(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getpriority(pid);
+}
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, (uint)mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
 }
@@ -0,0 +1,7 @@
+// clock_gettime() and nanosleep().
+#define CLOCK_MONOTONIC 1  // time since boot
+
+struct timespec {
+  uint64 tv_sec;
+  uint64 tv_nsec;  // 0 to 999999999
+};
@@ -0,0 +1,218 @@
+//
+// Timers: per-hart deadlines on the CLINT clock.
+//
+// Each hart has a queue of timers, a min-heap ordered by
+// deadline, and the deadline of its next scheduling tick. The
+// hart programs its CLINT mtimecmp with whichever of the two
+// comes first, so the timer interrupt arrives exactly when
+// there is something to do, instead of every tick: a hart that
+// is idle stops its ticks (timerstop()), and sleeps until the
+// next deadline in its queue, or for good if there is none.
+// timervec in kernelvec.S disarms mtimecmp when it fires, and
+// timerintr() runs what is due and programs the next deadline.
+//
+// timersleep() puts a timer for the calling process on the
+// queue of the hart it is running on, and sleeps on it; when the
+// timer is due, that hart wakes the process, and only it, once.
+//
+// Time is CLINT mtime, in cycles since boot, TIMEBASE a second.
+// The tick count of uptime() is derived from it, so no hart has
+// to keep ticking to keep count.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct timer {
+  uint64 when;   // deadline, in mtime cycles
+  int idx;       // index in the heap, or -1 once it has fired
+};
+
+static struct timerq {
+  struct spinlock lock;
+  struct timer *heap[NPROC];
+  int n;
+  uint64 tick;   // deadline of the next tick, or 0 if stopped
+} timerq[NCPU];
+
+void
+timerqinit(void)
+{
+  struct timerq *tq;
+
+  for(tq = timerq; tq < &timerq[NCPU]; tq++){
+    initlock(&tq->lock, "timerq");
+    tq->tick = timenow() + TICK;
+  }
+}
+
+// Cycles since boot.
+uint64
+timenow(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+// Ticks since boot.
+uint
+uptime(void)
+{
+  return timenow() / TICK;
+}
+
+static void
+swap(struct timerq *tq, int i, int j)
+{
+  struct timer *t = tq->heap[i];
+
+  tq->heap[i] = tq->heap[j];
+  tq->heap[j] = t;
+  tq->heap[i]->idx = i;
+  tq->heap[j]->idx = j;
+}
+
+// Restore heap order around heap[i], which has changed.
+static void
+fix(struct timerq *tq, int i)
+{
+  int c;
+
+  while(i > 0 && tq->heap[i]->when < tq->heap[(i-1)/2]->when){
+    swap(tq, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= tq->n)
+      break;
+    if(c + 1 < tq->n && tq->heap[c+1]->when < tq->heap[c]->when)
+      c++;
+    if(tq->heap[i]->when <= tq->heap[c]->when)
+      break;
+    swap(tq, i, c);
+    i = c;
+  }
+}
+
+static void
+insert(struct timerq *tq, struct timer *t)
+{
+  if(tq->n == NPROC)
+    panic("timerq full");
+  t->idx = tq->n;
+  tq->heap[tq->n++] = t;
+  fix(tq, t->idx);
+}
+
+static void
+delete(struct timerq *tq, struct timer *t)
+{
+  int i = t->idx;
+
+  t->idx = -1;
+  if(i == --tq->n)
+    return;
+  tq->heap[i] = tq->heap[tq->n];
+  tq->heap[i]->idx = i;
+  fix(tq, i);
+}
+
+// Program this hart's timer interrupt for its next deadline.
+// Caller must hold tq->lock, of this hart's queue.
+static void
+program(struct timerq *tq)
+{
+  uint64 when = tq->tick ? tq->tick : -1;
+
+  if(tq->n > 0 && tq->heap[0]->when < when)
+    when = tq->heap[0]->when;
+  *(volatile uint64*)CLINT_MTIMECMP(cpuid()) = when;
+}
+
+// Sleep until mtime reaches when. Returns 0 then, or -1 early
+// if the process is killed.
+int
+timersleep(uint64 when)
+{
+  struct proc *p = myproc();
+  struct timerq *tq;
+  struct timer t;
+
+  // on the queue of this hart, which cannot change while
+  // interrupts are off.
+  push_off();
+  tq = &timerq[cpuid()];
+  acquire(&tq->lock);
+  pop_off();
+  t.when = when;
+  insert(tq, &t);
+  program(tq);
+  while(t.idx >= 0){
+    if(p->killed){
+      delete(tq, &t);
+      release(&tq->lock);
+      return -1;
+    }
+    sleep(&t, &tq->lock);
+  }
+  release(&tq->lock);
+  return 0;
+}
+
+// A timer interrupt: wake the sleepers that are due on this
+// hart, and program the next deadline. Returns 1 if it is also
+// time for a scheduling tick.
+int
+timerintr(void)
+{
+  struct timerq *tq = &timerq[cpuid()];
+  struct timer *t;
+  uint64 now = timenow();
+  int tick = 0;
+
+  acquire(&tq->lock);
+  while(tq->n > 0 && tq->heap[0]->when <= now){
+    t = tq->heap[0];
+    delete(tq, t);
+    wakeup(t);
+  }
+  if(tq->tick && tq->tick <= now){
+    tick = 1;
+    tq->tick += TICK;
+    if(tq->tick <= now)
+      tq->tick = now + TICK;
+  }
+  program(tq);
+  release(&tq->lock);
+  return tick;
+}
+
+// Stop this hart's scheduling ticks, while it is idle. Its
+// timers still fire.
+void
+timerstop(void)
+{
+  struct timerq *tq = &timerq[cpuid()];
+
+  acquire(&tq->lock);
+  tq->tick = 0;
+  program(tq);
+  release(&tq->lock);
+}
+
+// Restart this hart's scheduling ticks.
+void
+timerstart(void)
+{
+  struct timerq *tq = &timerq[cpuid()];
+
+  acquire(&tq->lock);
+  tq->tick = timenow() + TICK;
+  program(tq);
+  release(&tq->lock);
+}
@@ -0,0 +1,241 @@
+//
+// tmpfs: an in-memory file system, normally mounted on /tmp.
+//
+// Inodes are kept in tmpfs.dinode[], in the same form as on
+// disk, and file content in pages from kalloc(). Nothing is
+// logged or goes through the buffer cache, and it is all lost
+// at reboot. fs.c calls the functions here, for inodes whose
+// dev is TMPDEV, wherever it would otherwise use the disk.
+//
+// A tmpfs block is a page: ip->addrs[] holds the page numbers
+// (physical address >> PGSHIFT) of NDIRECT pages and of an
+// indirect page of TNINDIRECT more. A 0 is a hole, which reads
+// as zeroes. As with the disk versions, callers hold ip->lock.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define TNINDIRECT (PGSIZE / sizeof(uint))
+#define TMAXFILE (NDIRECT + TNINDIRECT)
+
+#define PN(pa) ((uint)((uint64)(pa) >> PGSHIFT))
+#define PA(pn) ((char*)((uint64)(pn) << PGSHIFT))
+
+struct {
+  struct spinlock lock;  // protects dinode[], briefly
+  struct dinode dinode[NTMPINODE];
+} tmpfs;
+
+// Allocate a zeroed page for file content; 0 if out of memory.
+static uint
+tmppage(void)
+{
+  char *pg;
+
+  if((pg = kalloc()) == 0)
+    return 0;
+  memset(pg, 0, PGSIZE);
+  return PN(pg);
+}
+
+// Set up an empty root directory.
+void
+tmpinit(void)
+{
+  struct dinode *dip = &tmpfs.dinode[ROOTINO];
+  struct dirent *de;
+
+  initlock(&tmpfs.lock, "tmpfs");
+  if((dip->addrs[0] = tmppage()) == 0)
+    panic("tmpinit");
+  de = (struct dirent*)PA(dip->addrs[0]);
+  de[0].inum = ROOTINO;
+  strncpy(de[0].name, ".", DIRSIZ);
+  de[1].inum = ROOTINO;
+  strncpy(de[1].name, "..", DIRSIZ);
+  dip->type = T_DIR;
+  dip->nlink = 1;
+  dip->size = 2*sizeof(struct dirent);
+}
+
+// Allocate an inode of the given type.
+// Returns its number, or 0 if there are none left.
+uint
+tmpialloc(short type)
+{
+  uint inum;
+
+  acquire(&tmpfs.lock);
+  for(inum = 1; inum < NTMPINODE; inum++){
+    if(tmpfs.dinode[inum].type == 0){
+      memset(&tmpfs.dinode[inum], 0, sizeof(struct dinode));
+      tmpfs.dinode[inum].type = type;
+      release(&tmpfs.lock);
+      return inum;
+    }
+  }
+  release(&tmpfs.lock);
+  return 0;
+}
+
+// Free inode inum, which was allocated but never used.
+void
+tmpifree(uint inum)
+{
+  acquire(&tmpfs.lock);
+  tmpfs.dinode[inum].type = 0;
+  release(&tmpfs.lock);
+}
+
+// Fill in ip from its dinode, for ilock().
+void
+tmpiread(struct inode *ip)
+{
+  struct dinode *dip = &tmpfs.dinode[ip->inum];
+
+  acquire(&tmpfs.lock);
+  ip->type = dip->type;
+  ip->major = dip->major;
+  ip->minor = dip->minor;
+  ip->nlink = dip->nlink;
+  ip->size = dip->size;
+  memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+  release(&tmpfs.lock);
+}
+
+// Copy ip back to its dinode, for iupdate().
+// Setting type to 0 frees the inode.
+void
+tmpiupdate(struct inode *ip)
+{
+  struct dinode *dip = &tmpfs.dinode[ip->inum];
+
+  acquire(&tmpfs.lock);
+  dip->type = ip->type;
+  dip->major = ip->major;
+  dip->minor = ip->minor;
+  dip->nlink = ip->nlink;
+  dip->size = ip->size;
+  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  release(&tmpfs.lock);
+}
+
+// Return the page holding the nth page of ip's content. If
+// there is none, allocate it if alloc is 1, or else return 0.
+// Also returns 0 if out of memory.
+static char*
+tmpbmap(struct inode *ip, uint bn, int alloc)
+{
+  uint *a;
+
+  if(bn < NDIRECT){
+    if(ip->addrs[bn] == 0 && alloc)
+      ip->addrs[bn] = tmppage();
+    return ip->addrs[bn] ? PA(ip->addrs[bn]) : 0;
+  }
+  bn -= NDIRECT;
+
+  if(bn < TNINDIRECT){
+    if(ip->addrs[NDIRECT] == 0){
+      if(!alloc || (ip->addrs[NDIRECT] = tmppage()) == 0)
+        return 0;
+    }
+    a = (uint*)PA(ip->addrs[NDIRECT]);
+    if(a[bn] == 0 && alloc)
+      a[bn] = tmppage();
+    return a[bn] ? PA(a[bn]) : 0;
+  }
+
+  panic("tmpbmap: out of range");
+}
+
+// Free all of ip's content.
+void
+tmpitrunc(struct inode *ip)
+{
+  uint i, *a;
+
+  for(i = 0; i < NDIRECT; i++){
+    if(ip->addrs[i]){
+      kfree(PA(ip->addrs[i]));
+      ip->addrs[i] = 0;
+    }
+  }
+
+  if(ip->addrs[NDIRECT]){
+    a = (uint*)PA(ip->addrs[NDIRECT]);
+    for(i = 0; i < TNINDIRECT; i++){
+      if(a[i])
+        kfree(PA(a[i]));
+    }
+    kfree((char*)a);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  ip->size = 0;
+  tmpiupdate(ip);
+}
+
+// readi() for tmpfs; off and n are already within the file.
+int
+tmpreadi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  static char zeroes[PGSIZE];
+  uint tot, m;
+  char *pg;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    pg = tmpbmap(ip, off/PGSIZE, 0);
+    if(either_copyout(user_dst, dst, pg ? pg + off%PGSIZE : zeroes, m) == -1)
+      return -1;
+  }
+  return tot;
+}
+
+// writei() for tmpfs.
+int
+tmpwritei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m;
+  char *pg;
+
+  if(off + n < off || off + n > TMAXFILE*PGSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pg = tmpbmap(ip, off/PGSIZE, 1)) == 0)
+      break;  // out of memory
+    if(either_copyin(pg + off%PGSIZE, user_src, src, m) == -1)
+      break;
+  }
+
+  if(tot > 0 && off > ip->size)
+    ip->size = off;
+  tmpiupdate(ip);
+  return tot;
+}
+
+// iseek() for tmpfs.
+uint
+tmpiseek(struct inode *ip, uint off, int hole)
+{
+  uint bn;
+
+  for(bn = off / PGSIZE; bn * PGSIZE < ip->size; bn++){
+    if((tmpbmap(ip, bn, 0) == 0) == hole)
+      return bn * PGSIZE > off ? bn * PGSIZE : off;
+  }
+  return ip->size;
+}
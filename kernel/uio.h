@@ -0,0 +1,5 @@
+// One buffer of a readv()/writev() style scatter/gather list.
+struct iovec {
+  void *iov_base;  // user address of the buffer
+  uint64 iov_len;  // its length in bytes
+};
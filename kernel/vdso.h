@@ -0,0 +1,28 @@
+// Kernel state that user code reads without a system call.
+//
+// The kernel maps two read-only pages into every process: at
+// VDSO, one struct vdso that all processes share, and at
+// USYSCALL, a struct usyscall of the process's own. Together
+// with the time CSR, which user mode may read (rdtime), they
+// let user code get the time, the pid, and what the harts are
+// doing without a trap. The fields change under the reader's
+// feet; each is a word, read whole.
+
+// What a hart is doing.
+struct vdsocpu {
+  int pid;            // process running on it, or 0
+  int nrun;           // processes waiting on its run queue
+  int idle;           // asleep in wfi()?
+  int pad;
+};
+
+struct vdso {
+  uint64 timebase;    // time CSR cycles per second
+  uint64 tick;        // time CSR cycles per tick, as counted by uptime()
+  uint64 online;      // harts that are running, a bit each
+  struct vdsocpu cpu[NCPU];
+};
+
+struct usyscall {
+  int pid;            // the process's pid, getpid()
+};
@@ -18,12 +18,15 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | inode bit map | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
+int fssize = FSSIZE;  // Size of file system in blocks (-s)
+int ninodes = NINODES; // Number of inodes (-i)
+int nbitmap;
+int ninodeblocks;
+int ninodemap;
 int nlog = LOGSIZE;
-int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
+int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, inode map, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
@@ -34,6 +37,8 @@ uint freeblock;
 
 
 void balloc(int);
+void imapinit(int);
+void wbitmap(uint, int);
 void wsect(uint, void*);
 void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
@@ -77,8 +82,25 @@ main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  while(argc > 2 && argv[1][0] == '-'){
+    if(strcmp(argv[1], "-s") == 0)
+      fssize = atoi(argv[2]);
+    else if(strcmp(argv[1], "-i") == 0)
+      ninodes = atoi(argv[2]);
+    else
+      break;
+    argc -= 2;
+    argv += 2;
+  }
+
+  if(argc < 2 || argv[1][0] == '-'){
+    fprintf(stderr, "Usage: mkfs [-s blocks] [-i inodes] fs.img files...\n");
+    exit(1);
+  }
+
+  // dirent.inum is a ushort.
+  if(ninodes < 2 || ninodes > 65536){
+    fprintf(stderr, "mkfs: inode count must be between 2 and 65536\n");
     exit(1);
   }
 
@@ -90,24 +112,37 @@ main(int argc, char *argv[])
     die(argv[1]);
 
   // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  nbitmap = fssize/BPB + 1;
+  ninodeblocks = ninodes/IPB + 1;
+  ninodemap = ninodes/BPB + 1;
+  nmeta = 2 + nlog + ninodeblocks + ninodemap + nbitmap;
+  nblocks = fssize - nmeta;
+  if(nblocks <= 0){
+    fprintf(stderr, "mkfs: %d blocks is too small\n", fssize);
+    exit(1);
+  }
 
   sb.magic = FSMAGIC;
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ninodes);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.imapstart = xint(2+nlog+ninodeblocks);
+  sb.bsize = xint(BSIZE);
+  sb.bmapstart = xint(2+nlog+ninodeblocks+ninodemap);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("block size %d\n", BSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, inode map blocks %u, bitmap blocks %u) blocks %d total %d\n",
+         nmeta, nlog, ninodeblocks, ninodemap, nbitmap, nblocks, fssize);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  // size the image; the unwritten blocks read back as zeroes.
+  if(ftruncate(fsfd, (off_t)fssize * BSIZE) < 0)
+    die("ftruncate");
+  for(i = 0; i < nmeta; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -167,6 +202,7 @@ main(int argc, char *argv[])
   din.size = xint(off);
   winode(rootino, &din);
 
+  imapinit(freeinode);
   balloc(freeblock);
 
   exit(0);
@@ -175,7 +211,7 @@ main(int argc, char *argv[])
 void
 wsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
+  if(lseek(fsfd, (off_t)sec * BSIZE, 0) != (off_t)sec * BSIZE)
     die("lseek");
   if(write(fsfd, buf, BSIZE) != BSIZE)
     die("write");
@@ -211,7 +247,7 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * BSIZE, 0) != sec * BSIZE)
+  if(lseek(fsfd, (off_t)sec * BSIZE, 0) != (off_t)sec * BSIZE)
     die("lseek");
   if(read(fsfd, buf, BSIZE) != BSIZE)
     die("read");
@@ -223,6 +259,11 @@ ialloc(ushort type)
   uint inum = freeinode++;
   struct dinode din;
 
+  if(inum >= ninodes){
+    fprintf(stderr, "mkfs: out of inodes\n");
+    exit(1);
+  }
+
   bzero(&din, sizeof(din));
   din.type = xshort(type);
   din.nlink = xshort(1);
@@ -233,18 +274,38 @@ ialloc(ushort type)
 
 void
 balloc(int used)
+{
+  printf("balloc: first %d blocks have been allocated\n", used);
+  assert(used <= fssize);
+  wbitmap(xint(sb.bmapstart), used);
+}
+
+// Mark inodes 0..used-1 allocated in the inode bitmap.
+// Inode 0 is never handed out, so it is marked too.
+void
+imapinit(int used)
+{
+  printf("imapinit: first %d inodes have been allocated\n", used);
+  assert(used <= ninodemap*BPB);
+  wbitmap(xint(sb.imapstart), used);
+}
+
+// Write bitmap blocks starting at sector start with
+// bits 0..used-1 set.
+void
+wbitmap(uint start, int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int b, i;
 
-  printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  for(b = 0; b*BPB < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB && b*BPB + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("write bitmap block at sector %d\n", start + b);
+    wsect(start + b, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -281,6 +342,10 @@ iappend(uint inum, void *xp, int n)
       }
       x = xint(indirect[fbn-NDIRECT]);
     }
+    if(freeblock > fssize){
+      fprintf(stderr, "mkfs: out of blocks\n");
+      exit(1);
+    }
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
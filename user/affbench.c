@@ -0,0 +1,126 @@
+// Affinity benchmark.
+//
+// affbench [procs [trials]]
+//
+// Runs the given number of processes (default: one per hart)
+// at once, each sweeping its own 64 KB array over and over, a
+// load that does better the warmer it finds its hart's caches
+// and TLB. It does so for the given number of trials (default
+// 10), first with the processes free to run on any hart and
+// then with each pinned to one, and reports the fastest,
+// slowest, and mean ticks a trial took. Pinning should shrink
+// the spread between the fastest and the slowest.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define WSET  (64 * 1024)
+#define SWEEPS 400
+
+char wset[WSET];
+
+void
+sweep(void)
+{
+  int i, j;
+
+  for(i = 0; i < SWEEPS; i++)
+    for(j = 0; j < WSET; j += 64)
+      wset[j]++;
+  exit(0);
+}
+
+// The number of harts in mask.
+int
+ncpu(int mask)
+{
+  int id, n = 0;
+
+  for(id = 0; id < 32; id++)
+    if(mask & (1 << id))
+      n++;
+  return n;
+}
+
+// The i'th hart of mask, counting round.
+int
+nthcpu(int mask, int i)
+{
+  int id;
+
+  i %= ncpu(mask);
+  for(id = 0; ; id++){
+    if((mask & (1 << id)) && i-- == 0)
+      return id;
+  }
+}
+
+// Run one trial of n sweepers and return the ticks taken.
+int
+trial(int n, int pin, int mask)
+{
+  int i, t0, xst, bad = 0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "affbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(pin && sched_setaffinity(0, 1 << nthcpu(mask, i)) < 0)
+        exit(1);
+      sweep();
+    }
+  }
+  for(i = 0; i < n; i++){
+    wait(&xst);
+    bad |= xst;
+  }
+  if(bad){
+    fprintf(2, "affbench: a child failed\n");
+    exit(1);
+  }
+  return uptime() - t0;
+}
+
+void
+run(int n, int trials, int pin, int mask)
+{
+  int i, t, min = 0, max = 0, sum = 0;
+
+  for(i = 0; i < trials; i++){
+    t = trial(n, pin, mask);
+    if(i == 0 || t < min)
+      min = t;
+    if(i == 0 || t > max)
+      max = t;
+    sum += t;
+  }
+  printf("%s: min %d max %d mean %d ticks\n",
+         pin ? "pinned" : "free", min, max, sum / trials);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mask, nproc, trials;
+
+  if((mask = sched_getaffinity(0)) <= 0){
+    fprintf(2, "affbench: sched_getaffinity failed\n");
+    exit(1);
+  }
+  nproc = argc > 1 ? atoi(argv[1]) : ncpu(mask);
+  trials = argc > 2 ? atoi(argv[2]) : 10;
+  if(nproc < 1 || trials < 1){
+    fprintf(2, "usage: affbench [procs [trials]]\n");
+    exit(1);
+  }
+
+  printf("%d procs, %d trials\n", nproc, trials);
+  run(nproc, trials, 0, mask);
+  run(nproc, trials, 1, mask);
+  exit(0);
+}
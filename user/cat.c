@@ -2,21 +2,16 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 
-char buf[512];
-
 void
 cat(int fd)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
-      fprintf(2, "cat: write error\n");
-      exit(1);
-    }
-  }
+  // let the kernel move the data; no copies through user space.
+  while((n = sendfile(1, fd, 0, 64*1024)) > 0)
+    ;
   if(n < 0){
-    fprintf(2, "cat: read error\n");
+    fprintf(2, "cat: read or write error\n");
     exit(1);
   }
 }
@@ -0,0 +1,98 @@
+// find [dir [name]]: print the path of everything under dir,
+// or of just the entries called name.
+//
+// Each subdirectory is opened relative to its parent's fd with
+// openat(), so no lookup walks more than one path component.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+// entries fetched per getdents() call, at each level of the walk.
+#define NDS 8
+
+char path[MAXPATH];
+char *pattern;
+
+int
+match(char *name)
+{
+  return pattern == 0 || strcmp(name, pattern) == 0;
+}
+
+// Walk the directory open as fd, whose path is path[0..len).
+void
+find(int fd, int len)
+{
+  struct dirstat ds[NDS];
+  int i, n, l, sub;
+
+  while((n = getdents(fd, ds, NDS, 1)) > 0){
+    for(i = 0; i < n; i++){
+      if(strcmp(ds[i].name, ".") == 0 || strcmp(ds[i].name, "..") == 0)
+        continue;
+      l = strlen(ds[i].name);
+      if(len + 1 + l + 1 > MAXPATH){
+        fprintf(2, "find: path too long\n");
+        continue;
+      }
+      path[len] = '/';
+      strcpy(path + len + 1, ds[i].name);
+      if(match(ds[i].name))
+        printf("%s\n", path);
+      if(ds[i].st.type == T_DIR){
+        if((sub = openat(fd, ds[i].name, O_RDONLY)) < 0){
+          fprintf(2, "find: cannot open %s\n", path);
+          continue;
+        }
+        find(sub, len + 1 + l);
+        close(sub);
+      }
+    }
+  }
+  if(n < 0){
+    path[len] = 0;
+    fprintf(2, "find: cannot read %s\n", path);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  int fd, len;
+
+  strcpy(path, ".");
+  if(argc > 1){
+    if(strlen(argv[1]) >= MAXPATH){
+      fprintf(2, "find: path too long\n");
+      exit(1);
+    }
+    strcpy(path, argv[1]);
+  }
+  if(argc > 2)
+    pattern = argv[2];
+
+  if(fstatat(AT_FDCWD, path, &st) < 0){
+    fprintf(2, "find: cannot stat %s\n", path);
+    exit(1);
+  }
+  if(pattern == 0)
+    printf("%s\n", path);
+  if(st.type != T_DIR)
+    exit(0);
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    fprintf(2, "find: cannot open %s\n", path);
+    exit(1);
+  }
+  len = strlen(path);
+  while(len > 0 && path[len-1] == '/')
+    len--;
+  find(fd, len);
+  close(fd);
+  exit(0);
+}
@@ -1,5 +1,6 @@
 // init: The initial user-level program
 
+#include "kernel/param.h"
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/spinlock.h"
@@ -23,6 +24,11 @@ main(void)
   dup(0);  // stdout
   dup(0);  // stderr
 
+  // scratch space in memory.
+  mkdir("/tmp");
+  if(mount(TMPDEV, "/tmp") < 0)
+    printf("init: cannot mount tmpfs on /tmp\n");
+
   for(;;){
     printf("init: starting sh\n");
     pid = fork();
@@ -0,0 +1,123 @@
+// Stress test and benchmark for large file systems.
+// Fills the disk with MAXFILE-sized files totalling the given
+// number of megabytes (default 1024), reads them back and checks
+// every block, then removes them, reporting ticks for each phase.
+// The default needs an image made with something like
+//   make clean; make FSSIZE=1200000 NINODES=8000 qemu
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+#define CHUNK 8  // blocks per read() and write()
+
+char buf[CHUNK*BSIZE];
+
+void
+fname(char *name, int f)
+{
+  int i;
+
+  name[0] = 'f';
+  for(i = 6; i >= 1; i--){
+    name[i] = '0' + f % 10;
+    f /= 10;
+  }
+  name[7] = '\0';
+}
+
+// Stamp each block of the chunk with its file and block number.
+void
+stamp(int f, int bn)
+{
+  int k;
+
+  for(k = 0; k < CHUNK; k++){
+    ((uint*)(buf + k*BSIZE))[0] = f;
+    ((uint*)(buf + k*BSIZE))[1] = bn + k;
+  }
+}
+
+int
+check(int f, int bn)
+{
+  int k;
+
+  for(k = 0; k < CHUNK; k++){
+    if(((uint*)(buf + k*BSIZE))[0] != f || ((uint*)(buf + k*BSIZE))[1] != bn + k)
+      return -1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int mb, nfiles, nblocks, f, bn, fd, t0;
+  char name[8];
+
+  mb = 1024;
+  if(argc > 1)
+    mb = atoi(argv[1]);
+  nblocks = MAXFILE - MAXFILE % CHUNK;
+  nfiles = (mb * (1024 * 1024 / BSIZE) + nblocks - 1) / nblocks;
+
+  printf("largefs: %d files of %d blocks\n", nfiles, nblocks);
+  memset(buf, 'l', sizeof(buf));
+  if(mkdir("lfs") < 0 || chdir("lfs") < 0){
+    printf("largefs: cannot make lfs\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(f = 0; f < nfiles; f++){
+    fname(name, f);
+    if((fd = open(name, O_CREATE | O_WRONLY)) < 0){
+      printf("largefs: cannot create %s\n", name);
+      exit(1);
+    }
+    for(bn = 0; bn < nblocks; bn += CHUNK){
+      stamp(f, bn);
+      if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+        printf("largefs: write %s failed at block %d\n", name, bn);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  printf("largefs: write %d ticks\n", uptime() - t0);
+
+  t0 = uptime();
+  for(f = 0; f < nfiles; f++){
+    fname(name, f);
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("largefs: cannot open %s\n", name);
+      exit(1);
+    }
+    for(bn = 0; bn < nblocks; bn += CHUNK){
+      if(read(fd, buf, sizeof(buf)) != sizeof(buf) || check(f, bn) < 0){
+        printf("largefs: bad data in %s at block %d\n", name, bn);
+        exit(1);
+      }
+    }
+    close(fd);
+  }
+  printf("largefs: read %d ticks\n", uptime() - t0);
+
+  t0 = uptime();
+  for(f = 0; f < nfiles; f++){
+    fname(name, f);
+    if(unlink(name) < 0){
+      printf("largefs: cannot unlink %s\n", name);
+      exit(1);
+    }
+  }
+  printf("largefs: unlink %d ticks\n", uptime() - t0);
+
+  chdir("..");
+  unlink("lfs");
+  printf("largefs: ok\n");
+  exit(0);
+}
@@ -0,0 +1,65 @@
+// Response-latency benchmark for the scheduler.
+//
+// latbench [hogs [requests [nice]]]
+//
+// Starts the given number of CPU-bound hogs (default 8), at the
+// given nice level (default 0), then acts like an interactive
+// program: the given number of times (default 50) it sleeps for
+// a tick, as if waiting for a keystroke, and then does a little
+// work. It reports how many ticks past the sleeps the requests
+// took in all, which is the time spent waiting to run. With
+// round robin that grows with hogs per hart; with feedback
+// queues the sleeper should stay near the top and barely wait.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define MAXHOG 32
+
+volatile int sink;
+
+int
+main(int argc, char *argv[])
+{
+  int nhog, nreq, nice, i, j, t0, t, pids[MAXHOG];
+
+  nhog = argc > 1 ? atoi(argv[1]) : 8;
+  nreq = argc > 2 ? atoi(argv[2]) : 50;
+  nice = argc > 3 ? atoi(argv[3]) : 0;
+  if(nhog < 0 || nhog > MAXHOG || nreq < 1 || nice < 0 || nice >= NPRIO){
+    fprintf(2, "usage: latbench [hogs [requests [nice]]]\n");
+    exit(1);
+  }
+
+  for(i = 0; i < nhog; i++){
+    if((pids[i] = fork()) < 0){
+      fprintf(2, "latbench: fork failed\n");
+      exit(1);
+    }
+    if(pids[i] == 0){
+      setpriority(0, nice);
+      for(;;)
+        sink++;
+    }
+  }
+  sleep(2);  // let the hogs sink to their lowest level.
+
+  t0 = uptime();
+  for(i = 0; i < nreq; i++){
+    sleep(1);
+    for(j = 0; j < 10000; j++)
+      sink++;
+  }
+  t = uptime() - t0;
+
+  for(i = 0; i < nhog; i++)
+    kill(pids[i]);
+  for(i = 0; i < nhog; i++)
+    wait(0);
+
+  printf("%d hogs at nice %d: %d requests in %d ticks, %d ticks waiting\n",
+         nhog, nice, nreq, t, t > nreq ? t - nreq : 0);
+  exit(0);
+}
@@ -0,0 +1,28 @@
+// mount dev dir: mount device dev (2 for the second disk, 3 for
+// tmpfs) on directory dir.
+// mount -u dir: unmount the file system mounted on dir.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc != 3){
+    fprintf(2, "Usage: mount dev dir | mount -u dir\n");
+    exit(1);
+  }
+  if(strcmp(argv[1], "-u") == 0){
+    if(umount(argv[2]) < 0){
+      fprintf(2, "mount: cannot unmount %s\n", argv[2]);
+      exit(1);
+    }
+    exit(0);
+  }
+  if(mount(atoi(argv[1]), argv[2]) < 0){
+    fprintf(2, "mount: cannot mount %s on %s\n", argv[1], argv[2]);
+    exit(1);
+  }
+  exit(0);
+}
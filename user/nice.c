@@ -0,0 +1,23 @@
+// nice level cmd [arg ...]: run cmd at scheduling priority
+// level, from 0 (highest, the default) to NPRIO-1.
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    fprintf(2, "Usage: nice level cmd [arg ...]\n");
+    exit(1);
+  }
+  if(setpriority(0, atoi(argv[1])) < 0){
+    fprintf(2, "nice: level must be 0 to %d\n", NPRIO-1);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,103 @@
+// Benchmark for concurrent readers of one file.
+// Creates a file of the given number of blocks (default 64), then,
+// for 1, 2, 4, ... up to the given number of processes (default 4),
+// has each process open the file and read all of it the given
+// number of times (default 50), and reports the ticks taken. It
+// does this once with pread() and once with read() at the file
+// offset. With readers sharing the inode lock, the time should
+// stay about the same as processes are added, up to the number
+// of harts, either way.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+char buf[BSIZE];
+
+// Read the file at each block, in two halves, with pread(), or
+// with read() if usepread is 0.
+void
+reader(int nblocks, int rounds, int usepread)
+{
+  int fd, r, bn, ok;
+
+  if((fd = open("readers.tmp", O_RDONLY)) < 0){
+    fprintf(2, "readers: open failed\n");
+    exit(1);
+  }
+  for(r = 0; r < rounds; r++){
+    if(!usepread)
+      lseek(fd, 0, SEEK_SET);
+    for(bn = 0; bn < nblocks; bn++){
+      if(usepread)
+        ok = pread(fd, buf, 512, bn*BSIZE) == 512 &&
+             pread(fd, buf, 512, bn*BSIZE + 512) == 512;
+      else
+        ok = read(fd, buf, 512) == 512 && read(fd, buf, 512) == 512;
+      if(!ok || buf[0] != (char)bn){
+        fprintf(2, "readers: read failed\n");
+        exit(1);
+      }
+    }
+  }
+  close(fd);
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nblocks, nproc, rounds, n, i, fd, t0, xst, usepread;
+
+  nblocks = argc > 1 ? atoi(argv[1]) : 64;
+  nproc = argc > 2 ? atoi(argv[2]) : 4;
+  rounds = argc > 3 ? atoi(argv[3]) : 50;
+  if(nblocks < 1 || nblocks > MAXFILE || nproc < 1 || rounds < 1){
+    fprintf(2, "usage: readers [blocks [procs [rounds]]]\n");
+    exit(1);
+  }
+
+  if((fd = open("readers.tmp", O_CREATE|O_TRUNC|O_RDWR)) < 0){
+    fprintf(2, "readers: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < nblocks; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      fprintf(2, "readers: write failed\n");
+      exit(1);
+    }
+  }
+  close(fd);
+
+  for(usepread = 1; usepread >= 0; usepread--){
+    for(n = 1; ; n *= 2){
+      if(n > nproc)
+        n = nproc;
+      t0 = uptime();
+      for(i = 0; i < n; i++){
+        int pid = fork();
+        if(pid < 0){
+          fprintf(2, "readers: fork failed\n");
+          exit(1);
+        }
+        if(pid == 0)
+          reader(nblocks, rounds, usepread);
+      }
+      for(i = 0; i < n; i++){
+        wait(&xst);
+        if(xst != 0)
+          exit(1);
+      }
+      printf("%d readers, %s: %d ticks\n", n, usepread ? "pread" : "read",
+             uptime() - t0);
+      if(n == nproc)
+        break;
+    }
+  }
+
+  unlink("readers.tmp");
+  exit(0);
+}
@@ -0,0 +1,114 @@
+// Scheduler benchmark.
+//
+// schedbench [rounds [procs]]
+//
+// First, context switches: pairs of processes pass a byte back
+// and forth through two pipes the given number of times (default
+// 2000), which makes each side sleep and be woken once per round.
+// Then throughput: processes each spin through a fixed amount of
+// work. Both run with 1, 2, 4, ... up to the given number of
+// pairs or processes (default 8), and report the ticks taken.
+// Comparing runs with different CPUS shows how they scale with
+// the number of harts.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+volatile int sink;
+
+void
+pingpong(int rounds)
+{
+  int a[2], b[2], i, pid;
+  char c = 0;
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    fprintf(2, "schedbench: pipe failed\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    fprintf(2, "schedbench: fork failed\n");
+    exit(1);
+  }
+  for(i = 0; i < rounds; i++){
+    if(pid == 0){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        exit(1);
+    } else {
+      if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1)
+        exit(1);
+    }
+  }
+  if(pid != 0)
+    wait(0);
+  exit(0);
+}
+
+void
+spin(int rounds)
+{
+  int i, j;
+
+  for(i = 0; i < rounds; i++)
+    for(j = 0; j < 100000; j++)
+      sink += j;
+  exit(0);
+}
+
+// Run n copies of f(rounds) at once and return the ticks taken.
+int
+run(void (*f)(int), int n, int rounds)
+{
+  int i, t0, xst, bad = 0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "schedbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0)
+      f(rounds);
+  }
+  for(i = 0; i < n; i++){
+    wait(&xst);
+    bad |= xst;
+  }
+  if(bad){
+    fprintf(2, "schedbench: a child failed\n");
+    exit(1);
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds, nproc, n;
+
+  rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  nproc = argc > 2 ? atoi(argv[2]) : 8;
+  if(rounds < 1 || nproc < 1){
+    fprintf(2, "usage: schedbench [rounds [procs]]\n");
+    exit(1);
+  }
+
+  for(n = 1; ; n *= 2){
+    if(n > nproc)
+      n = nproc;
+    printf("%d pairs, %d round trips each: %d ticks\n",
+           n, rounds, run(pingpong, n, rounds));
+    if(n == nproc)
+      break;
+  }
+  for(n = 1; ; n *= 2){
+    if(n > nproc)
+      n = nproc;
+    printf("%d spinners: %d ticks\n", n, run(spin, n, rounds / 10 + 1));
+    if(n == nproc)
+      break;
+  }
+  exit(0);
+}
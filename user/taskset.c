@@ -0,0 +1,27 @@
+// taskset mask cmd [arg ...]: run cmd on only the harts in
+// mask, a number whose bit i allows hart i (5 is harts 0 and 2).
+// taskset with no command prints the harts that are running.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 1){
+    printf("%d\n", sched_getaffinity(0));
+    exit(0);
+  }
+  if(argc < 3){
+    fprintf(2, "Usage: taskset [mask cmd [arg ...]]\n");
+    exit(1);
+  }
+  if(sched_setaffinity(0, atoi(argv[1])) < 0){
+    fprintf(2, "taskset: mask %s has no running hart\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,178 @@
+// Threads: a thin layer over clone() and join().
+//
+// thread_create() runs fn(arg) in a new thread of the process,
+// on a stack from malloc(), and thread_join() waits for it and
+// returns what fn returned. The threads share all memory and
+// open files. A thread may also end early with exit(); its
+// join then yields 0.
+//
+// Mutexes, condition variables and semaphores for them are
+// built on futex(): they take and release with atomic
+// instructions alone, and enter the kernel only to sleep, when
+// they must wait, or to wake a sleeper.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+
+#define INT_MAX 0x7fffffff
+
+#define STACKSIZE (4*4096)
+
+struct thread {
+  int tid;
+  void *(*fn)(void*);
+  void *arg;
+  void *ret;
+  char *stack;
+};
+
+static void
+threadstart(void *a)
+{
+  struct thread *t = a;
+
+  t->ret = t->fn(t->arg);
+  exit(0);
+}
+
+int
+thread_create(struct thread **tp, void *(*fn)(void*), void *arg)
+{
+  struct thread *t;
+  uint64 sp;
+
+  if((t = malloc(sizeof(*t))) == 0)
+    return -1;
+  if((t->stack = malloc(STACKSIZE)) == 0){
+    free(t);
+    return -1;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  t->ret = 0;
+  sp = ((uint64)t->stack + STACKSIZE) & ~15L;
+  if((t->tid = clone(threadstart, t, (void*)sp)) < 0){
+    free(t->stack);
+    free(t);
+    return -1;
+  }
+  *tp = t;
+  return 0;
+}
+
+int
+thread_join(struct thread *t, void **ret)
+{
+  if(join(t->tid, 0) < 0)
+    return -1;
+  if(ret)
+    *ret = t->ret;
+  free(t->stack);
+  free(t);
+  return 0;
+}
+
+// A mutex's state is 0 when it is free, 1 when it is held, and
+// 2 when it is held and there may be sleepers to wake. (Ulrich
+// Drepper, "Futexes Are Tricky", mutex 2.)
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_SEQ_CST);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+// A waiter sleeps until seq moves on from the value it saw
+// while it still held the mutex, so it cannot miss a signal
+// sent after it let the mutex go. Like any condition variable,
+// it may wake without a signal, and must check its condition
+// again.
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_SEQ_CST);
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, INT_MAX);
+}
+
+// sem_post() enters the kernel only if some thread may be
+// asleep in sem_wait(), as counted by waiters.
+void
+sem_init(struct sem *s, int count)
+{
+  s->count = count;
+  s->waiters = 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+  int c;
+
+  for(;;){
+    c = __atomic_load_n(&s->count, __ATOMIC_SEQ_CST);
+    if(c > 0){
+      if(__sync_bool_compare_and_swap(&s->count, c, c - 1))
+        return;
+      continue;
+    }
+    __sync_fetch_and_add(&s->waiters, 1);
+    futex(&s->count, FUTEX_WAIT, c);
+    __sync_fetch_and_sub(&s->waiters, 1);
+  }
+}
+
+void
+sem_post(struct sem *s)
+{
+  __sync_fetch_and_add(&s->count, 1);
+  if(__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex(&s->count, FUTEX_WAKE, 1);
+}
@@ -0,0 +1,71 @@
+// System call versus vDSO benchmark.
+//
+// trapbench [calls]
+//
+// Times the given number of calls (default 10000) of getpid(),
+// uptime() and clock_gettime(), each through a system call and
+// through its trap-free vDSO version, and reports the mean
+// cost of a call in time CSR cycles.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+volatile int sink;
+
+// Mean thousandths of a cycle per call of f.
+int
+bench(int (*f)(void), int n)
+{
+  uint64 t0;
+  int i;
+
+  t0 = r_time();
+  for(i = 0; i < n; i++)
+    sink += f();
+  return (r_time() - t0) * 1000 / n;
+}
+
+int
+sysclock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_nsec;
+}
+
+int
+vdsoclock(void)
+{
+  struct timespec ts;
+
+  uclock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_nsec;
+}
+
+void
+report(char *name, int sys, int vdso)
+{
+  printf("%s: syscall %d.%d, vdso %d.%d cycles per call\n", name,
+         sys / 1000, sys % 1000 / 100, vdso / 1000, vdso % 1000 / 100);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = argc > 1 ? atoi(argv[1]) : 10000;
+  if(n < 1){
+    fprintf(2, "usage: trapbench [calls]\n");
+    exit(1);
+  }
+  report("getpid", bench(getpid, n), bench(ugetpid, n));
+  report("uptime", bench(uptime, n), bench(uuptime, n));
+  report("clock_gettime", bench(sysclock, n),
+         bench(vdsoclock, n));
+  exit(0);
+}
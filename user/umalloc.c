@@ -20,9 +20,10 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static struct mutex heaplock;  // the threads of a process share the heap
 
-void
-free(void *ap)
+static void
+free1(void *ap)
 {
   Header *bp, *p;
 
@@ -56,10 +57,18 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  free1((void*)(hp + 1));
   return freep;
 }
 
+void
+free(void *ap)
+{
+  mutex_lock(&heaplock);
+  free1(ap);
+  mutex_unlock(&heaplock);
+}
+
 void*
 malloc(uint nbytes)
 {
@@ -67,6 +76,7 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  mutex_lock(&heaplock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +91,13 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      mutex_unlock(&heaplock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        mutex_unlock(&heaplock);
         return 0;
+      }
   }
 }
@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct dirstat;
+struct thread;
+struct timespec;
+struct vdso;
 
 // system calls
 int fork(void);
@@ -23,6 +28,33 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int pread(int, void*, int, int);
+int pwrite(int, const void*, int, int);
+int readv(int, const struct iovec*, int);
+int writev(int, const struct iovec*, int);
+int preadv(int, const struct iovec*, int, int);
+int pwritev(int, const struct iovec*, int, int);
+int lseek(int, int, int);
+int sendfile(int, int, int*, int);
+int splice(int, int*, int, int*, int);
+int getdents(int, struct dirstat*, int, int);
+int openat(int, const char*, int);
+int mkdirat(int, const char*);
+int mknodat(int, const char*, short, short);
+int unlinkat(int, const char*);
+int linkat(int, const char*, int, const char*);
+int fstatat(int, const char*, struct stat*);
+int mount(int, const char*);
+int umount(const char*);
+int setpriority(int, int);
+int getpriority(int);
+int sched_setaffinity(int, int);
+int sched_getaffinity(int);
+int clone(void(*)(void*), void*, void*);
+int join(int, int*);
+int futex(int*, int, int);
+int nanosleep(const struct timespec*, struct timespec*);
+int clock_gettime(int, struct timespec*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +72,26 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+// thread.c
+struct mutex { int state; };            // 0 free, 1 held, 2 held and waited for
+struct cond { int seq; };               // bumped by each signal
+struct sem { int count; int waiters; };
+int thread_create(struct thread**, void*(*)(void*), void*);
+int thread_join(struct thread*, void**);
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void sem_init(struct sem*, int);
+void sem_wait(struct sem*);
+void sem_post(struct sem*);
+
+// vdso.c
+struct vdso* vdso(void);
+int ugetpid(void);
+int uuptime(void);
+int uclock_gettime(int, struct timespec*);
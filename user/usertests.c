@@ -4,6 +4,10 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/futex.h"
+#include "kernel/time.h"
+#include "kernel/vdso.h"
+#include "kernel/uio.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -623,6 +627,704 @@ writebig(char *s)
   }
 }
 
+// large reads that the kernel can do straight from the disk,
+// into aligned and unaligned buffers, must see the same data
+// as reads through the buffer cache, including blocks that
+// were just written and are still cached.
+void
+bigread(char *s)
+{
+  enum { N=8 };
+  int i, j, fd, off;
+  char *p;
+
+  fd = open("bigread", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N*BSIZE; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, N*BSIZE) != N*BSIZE){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(off = 0; off < 3; off++){
+    fd = open("bigread", O_RDONLY);
+    p = buf + off;
+    memset(buf, 0, BUFSZ);
+    if(read(fd, p, N*BSIZE) != N*BSIZE){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    for(i = 0; i < N*BSIZE; i++){
+      if(p[i] != (char)(i % 251)){
+        printf("%s: wrong byte %d at offset %d\n", s, i, off);
+        exit(1);
+      }
+    }
+
+    // overwrite part of a block, so that it is cached and
+    // newer than the copy on disk until the log installs it.
+    fd = open("bigread", O_RDWR);
+    j = (off + 2) * BSIZE + 7;
+    for(i = 0; i < j; i++)
+      buf[i] = i % 251;
+    buf[j] = 'x';
+    if(write(fd, buf, j + 1) != j + 1){
+      printf("%s: rewrite failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    fd = open("bigread", O_RDONLY);
+    memset(buf, 0, BUFSZ);
+    if(read(fd, buf, N*BSIZE) != N*BSIZE || buf[j] != 'x'){
+      printf("%s: stale read after write\n", s);
+      exit(1);
+    }
+    close(fd);
+    fd = open("bigread", O_RDWR);
+    for(i = 0; i < N*BSIZE; i++)
+      buf[i] = i % 251;
+    write(fd, buf, N*BSIZE);
+    close(fd);
+  }
+  unlink("bigread");
+}
+
+// O_DIRECT writes and reads, mixed with buffered ones on
+// the same file, must all see each other's data.
+void
+directio(char *s)
+{
+  enum { N=6 };
+  int i, fd, bfd;
+
+  fd = open("directio", O_CREATE|O_RDWR|O_DIRECT);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  // aligned blocks, then a tail that is not a whole block.
+  for(i = 0; i < N*BSIZE + 100; i++)
+    buf[i] = i % 253;
+  if(write(fd, buf, N*BSIZE + 100) != N*BSIZE + 100){
+    printf("%s: direct write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // a buffered write into the middle of a block the direct
+  // write put on disk.
+  bfd = open("directio", O_RDWR);
+  read(bfd, buf, BSIZE + 10);
+  if(write(bfd, "buffered", 8) != 8){
+    printf("%s: buffered write failed\n", s);
+    exit(1);
+  }
+
+  // a direct rewrite of block 2 while block 1 is cached.
+  fd = open("directio", O_RDWR|O_DIRECT);
+  read(fd, buf, 2*BSIZE);
+  memset(buf, 'd', BSIZE);
+  if(write(fd, buf, BSIZE) != BSIZE){
+    printf("%s: direct rewrite failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(bfd);
+
+  fd = open("directio", O_RDONLY|O_DIRECT);
+  memset(buf, 0, BUFSZ);
+  if(read(fd, buf, BUFSZ) != N*BSIZE + 100){
+    printf("%s: direct read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N*BSIZE + 100; i++){
+    char c = i % 253;
+    if(i >= BSIZE + 10 && i < BSIZE + 18)
+      c = "buffered"[i - BSIZE - 10];
+    else if(i >= 2*BSIZE && i < 3*BSIZE)
+      c = 'd';
+    if(buf[i] != c){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  unlink("directio");
+}
+
+// positional and vectored reads and writes.
+void
+preadwrite(char *s)
+{
+  int fd, fds[2];
+  char a[4], b[6], c[8];
+  struct iovec iov[3];
+
+  fd = open("prw", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "0123456789", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  // pread and pwrite don't move the file offset.
+  if(pwrite(fd, "ab", 2, 3) != 2 || pread(fd, a, 4, 2) != 4 ||
+     memcmp(a, "2ab5", 4) != 0){
+    printf("%s: pread/pwrite wrong\n", s);
+    exit(1);
+  }
+  if(write(fd, "x", 1) != 1 || pread(fd, c, 8, 5) != 6 ||
+     memcmp(c, "56789x", 6) != 0){
+    printf("%s: pwrite moved the offset\n", s);
+    exit(1);
+  }
+  if(pread(fd, a, 4, 20) != 0 || pread(fd, a, 4, -1) != -1){
+    printf("%s: pread past end\n", s);
+    exit(1);
+  }
+
+  // writev gathers, readv scatters.
+  iov[0].iov_base = "AB";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "CDEFG";
+  iov[2].iov_len = 5;
+  if(writev(fd, iov, 3) != 7){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = a;
+  iov[0].iov_len = 4;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 6;
+  iov[2].iov_base = c;
+  iov[2].iov_len = 8;
+  if(preadv(fd, iov, 3, 9) != 9 || memcmp(a, "9xAB", 4) != 0 ||
+     memcmp(b, "CDEFG", 5) != 0){
+    printf("%s: preadv wrong\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "--";
+  iov[0].iov_len = 2;
+  if(pwritev(fd, iov, 1, 0) != 2 || pread(fd, c, 3, 0) != 3 ||
+     memcmp(c, "--2", 3) != 0){
+    printf("%s: pwritev wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("prw", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 4;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 6;
+  if(readv(fd, iov, 2) != 10 || memcmp(a, "--2a", 4) != 0 ||
+     memcmp(b, "b56789", 6) != 0 || read(fd, c, 1) != 1 || c[0] != 'x'){
+    printf("%s: readv wrong\n", s);
+    exit(1);
+  }
+  // the byte count must fit in the int that is returned.
+  iov[0].iov_len = 0x80000000UL;
+  iov[1].iov_len = 0x40000000;
+  iov[2].iov_base = a;
+  iov[2].iov_len = 0x40000000;
+  if(readv(fd, iov, 1) != -1 || readv(fd, iov + 1, 2) != -1){
+    printf("%s: readv of more than INT_MAX bytes\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("prw");
+
+  // pipes have no offset.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(pwrite(fds[1], "x", 1, 0) != -1 || pread(fds[0], a, 1, 0) != -1){
+    printf("%s: positional I/O on a pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// lseek, and files with holes in them.
+void
+sparse(char *s)
+{
+  int fd, i;
+  char buf[BSIZE];
+
+  fd = open("sparse", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "head", 4) != 4 || lseek(fd, 0, SEEK_CUR) != 4){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  // seek well past the end and write; the gap is a hole.
+  if(lseek(fd, 20*BSIZE, SEEK_SET) != 20*BSIZE || write(fd, "tail", 4) != 4){
+    printf("%s: write past end failed\n", s);
+    exit(1);
+  }
+  if(lseek(fd, 0, SEEK_END) != 20*BSIZE+4 || lseek(fd, -4, SEEK_CUR) != 20*BSIZE ||
+     read(fd, buf, 5) != 4 || memcmp(buf, "tail", 4) != 0){
+    printf("%s: SEEK_END/SEEK_CUR wrong\n", s);
+    exit(1);
+  }
+  if(lseek(fd, -1, SEEK_SET) != -1 || lseek(fd, 0, 99) != -1){
+    printf("%s: bad lseek succeeded\n", s);
+    exit(1);
+  }
+  // writing nothing past the end does not grow the file.
+  if(lseek(fd, 30*BSIZE, SEEK_SET) != 30*BSIZE || write(fd, buf, 0) != 0 ||
+     lseek(fd, 0, SEEK_END) != 20*BSIZE+4){
+    printf("%s: empty write grew the file\n", s);
+    exit(1);
+  }
+
+  // the hole reads back as zeroes, through both read paths.
+  if(lseek(fd, 4, SEEK_SET) != 4 || read(fd, buf, BSIZE-4) != BSIZE-4){
+    printf("%s: read hole failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < BSIZE-4; i++){
+    if(buf[i] != 0){
+      printf("%s: hole not zero\n", s);
+      exit(1);
+    }
+  }
+  for(i = 1; i < 20; i++){
+    memset(buf, 'x', BSIZE);
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 0 || buf[BSIZE-1] != 0){
+      printf("%s: hole block %d not zero\n", s, i);
+      exit(1);
+    }
+  }
+
+  if(lseek(fd, 0, SEEK_HOLE) != BSIZE || lseek(fd, 0, SEEK_DATA) != 0 ||
+     lseek(fd, 5*BSIZE+7, SEEK_HOLE) != 5*BSIZE+7 ||
+     lseek(fd, BSIZE, SEEK_DATA) != 20*BSIZE ||
+     lseek(fd, 20*BSIZE+1, SEEK_HOLE) != 20*BSIZE+4 ||
+     lseek(fd, 20*BSIZE+4, SEEK_DATA) != -1){
+    printf("%s: SEEK_DATA/SEEK_HOLE wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("sparse");
+}
+
+// sendfile and splice move data between files in the kernel.
+void
+splicetest(char *s)
+{
+  int fd, fd1, fds[2], i, off, off1;
+  static char buf[3*BSIZE];
+
+  fd = open("splice0", O_CREATE|O_RDWR);
+  fd1 = open("splice1", O_CREATE|O_RDWR);
+  if(fd < 0 || fd1 < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 23;
+  if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  // file to file, with fd's own offset at the end, so
+  // reading at an explicit offset must leave it there.
+  off = 10;
+  if(sendfile(fd1, fd, &off, sizeof(buf)) != sizeof(buf)-10 ||
+     off != sizeof(buf) || lseek(fd, 0, SEEK_CUR) != sizeof(buf)){
+    printf("%s: sendfile wrong\n", s);
+    exit(1);
+  }
+  memset(buf, 0, sizeof(buf));
+  if(pread(fd1, buf, sizeof(buf), 0) != sizeof(buf)-10){
+    printf("%s: short copy\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(buf)-10; i++){
+    if(buf[i] != 'a' + (i+10) % 23){
+      printf("%s: bad data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // file to pipe to file.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  off = 0;
+  if(splice(fd, &off, fds[1], 0, 100) != 100 || off != 100){
+    printf("%s: splice to pipe wrong\n", s);
+    exit(1);
+  }
+  off1 = 5;
+  if(splice(fds[0], 0, fd1, &off1, 200) != 100 || off1 != 105){
+    printf("%s: splice from pipe wrong\n", s);
+    exit(1);
+  }
+  if(pread(fd1, buf, 3, 5) != 3 || buf[0] != 'a' || buf[2] != 'c'){
+    printf("%s: splice data wrong\n", s);
+    exit(1);
+  }
+  if(splice(fds[0], &off, fd1, 0, 10) != -1 || sendfile(fds[0], fd, 0, 10) != -1){
+    printf("%s: bad splice succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  close(fd1);
+  unlink("splice0");
+  unlink("splice1");
+}
+
+// getdents returns directory entries in batches, with metadata.
+void
+getdentstest(char *s)
+{
+  enum { N = 40 };
+  static char data[N];
+  struct dirstat ds[8];
+  char name[8];
+  int fd, i, n, nfile, ndir;
+
+  if(mkdir("gd") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    name[0] = 'g';
+    name[1] = 'd';
+    name[2] = '/';
+    name[3] = 'f';
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    name[6] = 0;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0 || write(fd, data, i) != i){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  unlink("gd/f07");
+
+  fd = open("gd", O_RDONLY);
+  nfile = ndir = 0;
+  while((n = getdents(fd, ds, 8, 1)) > 0){
+    for(i = 0; i < n; i++){
+      if(ds[i].st.type == T_DIR){
+        ndir++;
+      } else if(ds[i].st.type == T_FILE && ds[i].name[0] == 'f' &&
+                ds[i].st.size == (ds[i].name[1]-'0')*10 + ds[i].name[2]-'0'){
+        nfile++;
+      } else {
+        printf("%s: bad entry %s\n", s, ds[i].name);
+        exit(1);
+      }
+    }
+  }
+  if(n < 0 || ndir != 2 || nfile != N-1){
+    printf("%s: getdents found %d dirs, %d files\n", s, ndir, nfile);
+    exit(1);
+  }
+
+  // without metadata, only the inode number comes back.
+  lseek(fd, 0, SEEK_SET);
+  if(getdents(fd, ds, 1, 0) != 1 || strcmp(ds[0].name, ".") != 0 ||
+     ds[0].st.type != 0 || ds[0].st.ino == 0){
+    printf("%s: getdents without stat wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("gd/f00", O_RDONLY);
+  if(getdents(fd, ds, 8, 1) != -1){
+    printf("%s: getdents on a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(i = 0; i < N; i++){
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    unlink(name);
+  }
+  if(unlink("gd") < 0){
+    printf("%s: unlink gd failed\n", s);
+    exit(1);
+  }
+}
+
+// the *at() calls look paths up relative to a directory fd.
+void
+attest(char *s)
+{
+  int dfd, fd;
+  struct stat st;
+
+  if(mkdir("at") < 0 || (dfd = open("at", O_RDONLY)) < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((fd = openat(dfd, "f", O_CREATE|O_RDWR)) < 0 || write(fd, "hello", 5) != 5){
+    printf("%s: openat create failed\n", s);
+    exit(1);
+  }
+  if(fstatat(AT_FDCWD, "at/f", &st) < 0 || st.type != T_FILE || st.size != 5){
+    printf("%s: fstatat AT_FDCWD wrong\n", s);
+    exit(1);
+  }
+
+  // a file is not a directory to start from.
+  if(openat(fd, "f", O_RDONLY) != -1 || mkdirat(fd, "x") != -1){
+    printf("%s: file used as a directory\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(mkdirat(dfd, "d") < 0 || linkat(dfd, "f", dfd, "d/g") < 0 ||
+     fstatat(dfd, "d/g", &st) < 0 || st.nlink != 2 || st.size != 5){
+    printf("%s: mkdirat/linkat failed\n", s);
+    exit(1);
+  }
+  if(mknodat(dfd, "d/n", 99, 0) < 0 || fstatat(dfd, "d/n", &st) < 0 ||
+     st.type != T_DEVICE){
+    printf("%s: mknodat failed\n", s);
+    exit(1);
+  }
+  // absolute paths ignore the directory fd.
+  if(fstatat(dfd, "/at/d", &st) < 0 || st.type != T_DIR){
+    printf("%s: absolute fstatat failed\n", s);
+    exit(1);
+  }
+
+  if(unlinkat(dfd, "d") != -1){
+    printf("%s: unlinkat of non-empty dir succeeded\n", s);
+    exit(1);
+  }
+  if(unlinkat(dfd, "d/g") < 0 || unlinkat(dfd, "d/n") < 0 ||
+     unlinkat(dfd, "d") < 0 || unlinkat(dfd, "f") < 0 ||
+     fstatat(dfd, "f", &st) != -1){
+    printf("%s: unlinkat failed\n", s);
+    exit(1);
+  }
+  close(dfd);
+  if(unlinkat(AT_FDCWD, "at") < 0){
+    printf("%s: unlinkat AT_FDCWD failed\n", s);
+    exit(1);
+  }
+}
+
+// readers share the inode lock; they must still never see a
+// block half-way through being rewritten.
+void
+sharedread(char *s)
+{
+  enum { NCHILD = 4, NBLK = 4, ROUNDS = 50 };
+  static char buf[BSIZE];
+  int fd, i, j, r, pid, xst;
+
+  fd = open("sharedread", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', BSIZE);
+  for(i = 0; i < NBLK; i++)
+    write(fd, buf, BSIZE);
+
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(r = 0; r < ROUNDS*NBLK; r++){
+        if(pread(fd, buf, BSIZE, (r % NBLK)*BSIZE) != BSIZE){
+          printf("%s: pread failed\n", s);
+          exit(1);
+        }
+        for(j = 1; j < BSIZE; j++){
+          if(buf[j] != buf[0]){
+            printf("%s: torn block\n", s);
+            exit(1);
+          }
+        }
+      }
+      exit(0);
+    }
+  }
+
+  for(r = 0; r < ROUNDS; r++){
+    memset(buf, 'a' + r % 26, BSIZE);
+    for(i = 0; i < NBLK; i++)
+      pwrite(fd, buf, BSIZE, i*BSIZE);
+  }
+  for(i = 0; i < NCHILD; i++){
+    wait(&xst);
+    if(xst != 0)
+      exit(1);
+  }
+  close(fd);
+  unlink("sharedread");
+}
+
+// path lookups that hit the directory entry cache must not
+// see names that have since been removed or replaced.
+void
+dcachetest(char *s)
+{
+  int fd, i;
+  struct stat st;
+
+  for(i = 0; i < 3; i++){
+    if(mkdir("dc") < 0 || mkdir("dc/d") < 0){
+      printf("%s: mkdir failed\n", s);
+      exit(1);
+    }
+    fd = open("dc/d/f", O_CREATE|O_RDWR);
+    if(fd < 0 || stat("dc/d/f", &st) < 0 || stat("dc/d/../d/./f", &st) < 0){
+      printf("%s: lookup failed\n", s);
+      exit(1);
+    }
+    close(fd);
+
+    // rename f to g.
+    if(link("dc/d/f", "dc/d/g") < 0 || unlink("dc/d/f") < 0){
+      printf("%s: link/unlink failed\n", s);
+      exit(1);
+    }
+    if(open("dc/d/f", O_RDONLY) >= 0 || stat("dc/d/g", &st) < 0){
+      printf("%s: stale name after unlink\n", s);
+      exit(1);
+    }
+
+    // replace the directory d with a file of the same name.
+    unlink("dc/d/g");
+    if(unlink("dc/d") < 0){
+      printf("%s: unlink dc/d failed\n", s);
+      exit(1);
+    }
+    fd = open("dc/d", O_CREATE|O_RDWR);
+    if(fd < 0 || fstat(fd, &st) < 0 || st.type != T_FILE){
+      printf("%s: create dc/d failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if(open("dc/d/g", O_RDONLY) >= 0 || open("dc/d/..", O_RDONLY) >= 0){
+      printf("%s: looked up through a removed directory\n", s);
+      exit(1);
+    }
+    unlink("dc/d");
+    if(unlink("dc") < 0){
+      printf("%s: unlink dc failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// tmpfs, which init mounts on /tmp, and crossing mount points.
+void
+mounttest(char *s)
+{
+  enum { N = 3*4096 };
+  static char buf[N];
+  struct stat st;
+  int fd, i;
+
+  if(stat("/tmp", &st) < 0 || st.dev != TMPDEV || st.ino != ROOTINO){
+    printf("%s: /tmp is not tmpfs\n", s);
+    exit(1);
+  }
+  if(stat("/tmp/..", &st) < 0 || st.dev != ROOTDEV || st.ino != ROOTINO){
+    printf("%s: /tmp/.. is not /\n", s);
+    exit(1);
+  }
+
+  if(mkdir("/tmp/mtd") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  fd = open("/tmp/mtd/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    buf[i] = i % 251;
+  // leave a page-sized hole after the first page.
+  if(write(fd, buf, 4096) != 4096 || lseek(fd, 2*4096, SEEK_SET) != 2*4096 ||
+     write(fd, buf + 2*4096, 4096) != 4096){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  memset(buf + 4096, 0, 4096);
+  close(fd);
+
+  fd = open("/tmp/mtd/../mtd/f", O_RDONLY);
+  if(fd < 0 || fstat(fd, &st) < 0 || st.dev != TMPDEV || st.size != N){
+    printf("%s: open or stat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    char c;
+    if(read(fd, &c, 1) != 1 || c != buf[i]){
+      printf("%s: wrong content at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  if(umount("/tmp") == 0){
+    printf("%s: unmounted a busy file system\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(link("/tmp/mtd/f", "mtlink") == 0){
+    printf("%s: linked across file systems\n", s);
+    exit(1);
+  }
+  if(unlink("/tmp") == 0 || mount(TMPDEV, "/") == 0){
+    printf("%s: unlinked or mounted over a mount point\n", s);
+    exit(1);
+  }
+
+  // unmount and mount again; the content survives.
+  if(umount("/tmp") < 0 || stat("/tmp", &st) < 0 || st.dev != ROOTDEV){
+    printf("%s: umount failed\n", s);
+    exit(1);
+  }
+  if(mount(TMPDEV, "/tmp") < 0 || stat("/tmp/mtd/f", &st) < 0){
+    printf("%s: remount failed\n", s);
+    exit(1);
+  }
+
+  if(unlink("/tmp/mtd/f") < 0 || unlink("/tmp/mtd") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+}
+
 // many creates, followed by unlink test
 void
 createtest(char *s)
@@ -1206,6 +1908,64 @@ fourfiles(char *s)
   }
 }
 
+// more processes hold more files open at once than NINODE,
+// to test that the inode table grows instead of running out.
+void
+manyinodes(char *s)
+{
+  enum { NCHILD=6, N=10 };
+  int ready[2], go[2];
+  int pid, i, pi, fd, xstatus;
+  char name[8], c;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(pi = 0; pi < NCHILD; pi++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(go[1]);
+      close(ready[0]);
+      name[0] = 'i';
+      name[1] = 'n';
+      name[2] = '0' + pi;
+      name[4] = '\0';
+      for(i = 0; i < N; i++){
+        name[3] = 'a' + i;
+        if((fd = open(name, O_CREATE | O_RDWR)) < 0){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);
+      for(i = 0; i < N; i++){
+        name[3] = 'a' + i;
+        unlink(name);
+      }
+      exit(0);
+    }
+  }
+  close(go[0]);
+  for(pi = 0; pi < NCHILD; pi++){
+    if(read(ready[0], &c, 1) != 1){
+      printf("%s: child did not open its files\n", s);
+      exit(1);
+    }
+  }
+  close(go[1]);
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
 // four processes create and delete different files in same directory
 void
 createdelete(char *s)
@@ -2040,13 +2800,528 @@ iref(char *s)
   chdir("/");
 }
 
+// processes that sleep and wake must keep getting to run while
+// CPU-bound ones fill every run queue.
+void
+runqtest(char *s)
+{
+  enum { NSPIN = 2*NCPU, ROUNDS = 200 };
+  int spinners[NSPIN], a[2], b[2], i, pid;
+  char c = 0;
+
+  for(i = 0; i < NSPIN; i++){
+    if((spinners[i] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(spinners[i] == 0)
+      for(;;)
+        ;
+  }
+
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < ROUNDS; i++){
+    if(pid == 0){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        exit(1);
+    } else if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1){
+      printf("%s: ping-pong failed\n", s);
+      exit(1);
+    }
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+
+  for(i = 0; i < NSPIN; i++)
+    kill(spinners[i]);
+  for(i = 0; i < NSPIN; i++)
+    wait(0);
+}
+
+// setpriority() and getpriority(), and inheritance by fork().
+void
+prioritytest(char *s)
+{
+  int pid, xst;
+
+  if(getpriority(0) != 0 || getpriority(getpid()) != 0){
+    printf("%s: default priority is not 0\n", s);
+    exit(1);
+  }
+  if(setpriority(0, NPRIO) == 0 || setpriority(0, -1) == 0){
+    printf("%s: set an invalid priority\n", s);
+    exit(1);
+  }
+  if(setpriority(0, NPRIO-1) < 0 || getpriority(0) != NPRIO-1){
+    printf("%s: setpriority failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getpriority(0) == NPRIO-1 ? 0 : 1);
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child did not inherit its priority\n", s);
+    exit(1);
+  }
+  if(setpriority(0, 0) < 0 || getpriority(0) != 0){
+    printf("%s: setpriority back to 0 failed\n", s);
+    exit(1);
+  }
+  if(getpriority(NPROC * 1000) != -1){
+    printf("%s: priority of a missing process\n", s);
+    exit(1);
+  }
+}
+
+// sched_setaffinity() and sched_getaffinity(), and inheritance
+// by fork().
+void
+affinitytest(char *s)
+{
+  int all, one, pid, xst;
+
+  all = sched_getaffinity(0);
+  if(all <= 0 || sched_getaffinity(getpid()) != all){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, 0) == 0 || sched_setaffinity(0, 1 << 30) == 0){
+    printf("%s: set an affinity with no running hart\n", s);
+    exit(1);
+  }
+  one = all & -all;
+  if(sched_setaffinity(0, one) < 0 || sched_getaffinity(0) != one){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(1);
+    exit(sched_getaffinity(0) == one ? 0 : 1);
+  }
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child did not inherit its affinity\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, all) < 0 || sched_getaffinity(0) != all){
+    printf("%s: sched_setaffinity back to all failed\n", s);
+    exit(1);
+  }
+  if(sched_getaffinity(NPROC * 1000) != -1){
+    printf("%s: affinity of a missing process\n", s);
+    exit(1);
+  }
+}
+
+// clone() threads: shared memory, shared open files, join(),
+// and the end of the whole process when its leader exits.
+#define NTHREAD 4
+int threadcount;
+int threadfd;
+
+void*
+threadadd(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++)
+    __sync_fetch_and_add(&threadcount, 1);
+  return arg;
+}
+
+void*
+threadpipe(void *arg)
+{
+  int fds[2];
+
+  if(pipe(fds) < 0)
+    return 0;
+  threadfd = fds[1];
+  close(fds[0]);
+  return (void*)1;
+}
+
+void*
+threadspin(void *arg)
+{
+  for(;;)
+    ;
+  return 0;
+}
+
+void
+clonetest(char *s)
+{
+  struct thread *t[NTHREAD];
+  void *ret;
+  int i, pid, xst;
+  char *echoargv[] = { "echo", "THIS SHOULD NOT BE PRINTED", 0 };
+
+  threadcount = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(&t[i], threadadd, (void*)(uint64)i) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_join(t[i], &ret) < 0 || ret != (void*)(uint64)i){
+      printf("%s: thread_join failed\n", s);
+      exit(1);
+    }
+  }
+  if(threadcount != NTHREAD * 1000){
+    printf("%s: threads do not share memory: %d\n", s, threadcount);
+    exit(1);
+  }
+  if(join(0, 0) != -1){
+    printf("%s: joined a thread that does not exist\n", s);
+    exit(1);
+  }
+
+  // a file opened by a thread is open in the process.
+  threadfd = -1;
+  if(thread_create(&t[0], threadpipe, 0) < 0 ||
+     thread_join(t[0], &ret) < 0 || ret == 0){
+    printf("%s: thread pipe failed\n", s);
+    exit(1);
+  }
+  if(close(threadfd) < 0){
+    printf("%s: threads do not share open files\n", s);
+    exit(1);
+  }
+
+  // a process with threads cannot shrink or exec, and takes them
+  // with it when it exits.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(thread_create(&t[0], threadspin, 0) < 0)
+      exit(1);
+    if(sbrk(-4096) != (char*)-1)
+      exit(1);
+    if(exec("echo", echoargv) != -1)
+      exit(1);
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: threaded child failed\n", s);
+    exit(1);
+  }
+}
+
+// futex(), and the mutexes, condition variables and semaphores
+// in ulib built on it.
+struct mutex futexmu;
+struct cond futexcv;
+struct sem futexsem;
+int futexcount;
+int futexready;
+
+void*
+futexadd(void *arg)
+{
+  int i, v;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&futexmu);
+    v = futexcount;
+    futexcount = v + 1;
+    mutex_unlock(&futexmu);
+  }
+  return 0;
+}
+
+void*
+futexwaiter(void *arg)
+{
+  mutex_lock(&futexmu);
+  while(futexready == 0)
+    cond_wait(&futexcv, &futexmu);
+  futexready--;
+  mutex_unlock(&futexmu);
+  sem_wait(&futexsem);
+  return 0;
+}
+
+void
+futextest(char *s)
+{
+  struct thread *t[NTHREAD];
+  int i, x = 0;
+
+  if(futex(&x, FUTEX_WAIT, 1) != -1){
+    printf("%s: FUTEX_WAIT slept though the value differs\n", s);
+    exit(1);
+  }
+  if(futex(&x, FUTEX_WAKE, 1) != 0){
+    printf("%s: FUTEX_WAKE woke someone\n", s);
+    exit(1);
+  }
+  if(futex((int*)((char*)&x + 1), FUTEX_WAKE, 1) != -1 ||
+     futex((int*)0x3fffff000, FUTEX_WAKE, 1) != -1){
+    printf("%s: futex on a bad address\n", s);
+    exit(1);
+  }
+
+  mutex_init(&futexmu);
+  futexcount = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(&t[i], futexadd, 0) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < NTHREAD; i++)
+    thread_join(t[i], 0);
+  if(futexcount != NTHREAD * 1000){
+    printf("%s: mutex lost updates: %d\n", s, futexcount);
+    exit(1);
+  }
+
+  cond_init(&futexcv);
+  sem_init(&futexsem, 0);
+  futexready = 0;
+  for(i = 0; i < NTHREAD; i++){
+    if(thread_create(&t[i], futexwaiter, 0) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  sleep(1);
+  mutex_lock(&futexmu);
+  futexready = NTHREAD;
+  cond_broadcast(&futexcv);
+  mutex_unlock(&futexmu);
+  for(i = 0; i < NTHREAD; i++)
+    sem_post(&futexsem);
+  for(i = 0; i < NTHREAD; i++)
+    thread_join(t[i], 0);
+  if(futexready != 0 || futexsem.count != 0){
+    printf("%s: condition variable or semaphore failed\n", s);
+    exit(1);
+  }
+}
+
+// clock_gettime() and nanosleep(): microsecond sleeps that
+// neither wake early nor wait for the next tick.
+uint64
+usec(struct timespec *ts)
+{
+  return ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+void
+nanosleeptest(char *s)
+{
+  struct timespec t0, t1, req;
+  uint64 d;
+  int i, pid, xst;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0 || t0.tv_nsec >= 1000000000){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  if(clock_gettime(CLOCK_MONOTONIC + 1, &t0) != -1){
+    printf("%s: clock_gettime of a bad clock\n", s);
+    exit(1);
+  }
+  req.tv_sec = 0;
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req, 0) != -1){
+    printf("%s: nanosleep with a bad tv_nsec\n", s);
+    exit(1);
+  }
+
+  // much shorter than a tick, a few times over.
+  for(i = 0; i < 5; i++){
+    req.tv_sec = 0;
+    req.tv_nsec = 2000000;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if(nanosleep(&req, 0) < 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    d = usec(&t1) - usec(&t0);
+    if(d < 2000){
+      printf("%s: nanosleep of 2000us woke after %dus\n", s, (int)d);
+      exit(1);
+    }
+    if(d > 50000){
+      printf("%s: nanosleep of 2000us took %dus\n", s, (int)d);
+      exit(1);
+    }
+  }
+
+  // a sleeper that is killed wakes at once.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    req.tv_sec = 1000;
+    req.tv_nsec = 0;
+    nanosleep(&req, 0);
+    exit(0);
+  }
+  sleep(1);
+  kill(pid);
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: killed sleeper was not killed\n", s);
+    exit(1);
+  }
+}
+
+// the vDSO and usyscall pages: trap-free getpid(), uptime()
+// and clock_gettime() agree with the system calls, and the
+// pages are read-only.
+void
+vdsotest(char *s)
+{
+  struct timespec t0, t1;
+  int pid, xst;
+
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid %d, getpid %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(ugetpid() == getpid() ? 0 : 1);
+  wait(&xst);
+  if(xst != 0){
+    printf("%s: child's ugetpid is wrong\n", s);
+    exit(1);
+  }
+
+  if(uuptime() - uptime() > 1 || uptime() - uuptime() > 1){
+    printf("%s: uuptime %d, uptime %d\n", s, uuptime(), uptime());
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  uclock_gettime(CLOCK_MONOTONIC, &t1);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if(usec(&t1) > usec(&t0) || usec(&t0) - usec(&t1) > 100000){
+    printf("%s: uclock_gettime is off\n", s);
+    exit(1);
+  }
+  if(vdso()->online == 0 || vdso()->tick == 0){
+    printf("%s: vdso page is empty\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(int*)USYSCALL = 0;
+    exit(0);
+  }
+  wait(&xst);
+  if(xst != -1){
+    printf("%s: wrote the usyscall page\n", s);
+    exit(1);
+  }
+}
+
+// more live processes than the old fixed process table held:
+// each can be found by pid, one killed, and all waited for.
+void
+manyproctest(char *s)
+{
+  enum { NCHILD = 200 };
+  int fds[2], pids[NCHILD], i, j, pid, xst, nkilled;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork %d failed\n", s, i);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);
+      exit(0);
+    }
+  }
+  for(i = 0; i < NCHILD; i++){
+    if(getpriority(pids[i]) < 0){
+      printf("%s: cannot find pid %d\n", s, pids[i]);
+      exit(1);
+    }
+  }
+  if(kill(pids[NCHILD/2]) < 0){
+    printf("%s: kill failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  nkilled = 0;
+  for(i = 0; i < NCHILD; i++){
+    if((pid = wait(&xst)) < 0){
+      printf("%s: wait stopped early\n", s);
+      exit(1);
+    }
+    for(j = 0; j < NCHILD && pids[j] != pid; j++)
+      ;
+    if(j == NCHILD){
+      printf("%s: wait returned a stranger %d\n", s, pid);
+      exit(1);
+    }
+    pids[j] = 0;
+    if(xst == -1)
+      nkilled++;
+  }
+  if(nkilled != 1 || wait(0) != -1){
+    printf("%s: %d killed, or too many children\n", s, nkilled);
+    exit(1);
+  }
+}
+
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// the forktest binary also does this, with many more processes.
+// inside the bigger usertests binary, we run out of memory sooner.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 10000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +3338,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2847,6 +4122,7 @@ main(int argc, char *argv[])
     {concreate, "concreate"},
     {subdir, "subdir"},
     {fourfiles, "fourfiles"},
+    {manyinodes, "manyinodes"},
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
@@ -2865,6 +4141,16 @@ main(int argc, char *argv[])
     {opentest, "opentest"},
     {writetest, "writetest"},
     {writebig, "writebig"},
+    {bigread, "bigread"},
+    {directio, "directio"},
+    {preadwrite, "preadwrite"},
+    {sparse, "sparse"},
+    {splicetest, "splice"},
+    {getdentstest, "getdents"},
+    {attest, "at"},
+    {sharedread, "sharedread"},
+    {dcachetest, "dcache"},
+    {mounttest, "mount"},
     {createtest, "createtest"},
     {openiputtest, "openiput"},
     {exitiputtest, "exitiput"},
@@ -2880,6 +4166,14 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {runqtest, "runq"},
+    {prioritytest, "priority"},
+    {affinitytest, "affinity"},
+    {clonetest, "clone"},
+    {futextest, "futex"},
+    {nanosleeptest, "nanosleep"},
+    {vdsotest, "vdso"},
+    {manyproctest, "manyproc"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
@@ -36,3 +36,30 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("preadv");
+entry("pwritev");
+entry("lseek");
+entry("sendfile");
+entry("splice");
+entry("getdents");
+entry("openat");
+entry("mkdirat");
+entry("mknodat");
+entry("unlinkat");
+entry("linkat");
+entry("fstatat");
+entry("mount");
+entry("umount");
+entry("setpriority");
+entry("getpriority");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("clone");
+entry("join");
+entry("futex");
+entry("nanosleep");
+entry("clock_gettime");